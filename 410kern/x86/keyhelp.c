@@ -9,10 +9,24 @@
  *
  * @author Rewritten by nwf for spring 2007.
  *
+ * @author Made table driven by bradleyz for spring 2020.
+ *
  * Functions for turning keyboard scancodes
  * into chars.
  *
  * Notice that we use Scancode Set 1
+ *
+ * Every key is described by an entry in one of two tables, one for plain
+ * scancodes and one for scancodes following an E0 prefix.  An entry gives
+ * the key's raw code, its result bits, the key_state bits it holds down or
+ * toggles, and its character under each of the eight combinations of
+ * shift, caps lock and control.  Decoding a byte is then a couple of table
+ * lookups and some masking, with no per-key branches.
+ *
+ * The multi-byte PRINT SCREEN and PAUSE sequences are small state machines
+ * whose transitions are tables too: each byte is sorted into a class, and
+ * the state it was read in and its class give the next state and what to
+ * do with the byte.
  */
 /*@{*/
 
@@ -29,567 +43,279 @@
  */
 static short key_state = 0;
 
-  /** Currently processing a PRINT SCREEN BREAK sequence */
-#define KH_PRSCR_UP_SCAN    0x0008
-  /** Currently processing a PRINT SCREEN MAKE sequence */
-#define KH_PRSCR_DOWN_SCAN  0x0004
-  /** Currently processing a PAUSE/BREAK (MAKE) sequence */
-#define KH_PAUSE_SCAN       0x0002
   /** Currently processing an extended sequence (E0 prefix) */
-#define KH_EXTENDED_SCAN    0x0001
-static short key_internal_state = 0;
+static int key_extended = 0;
 
-static int key_sequence = 0;
+/**@{ Modifier classes, the second index of key_entry_t's chars */
+#define KH_CLASS_SHIFT      0x1
+#define KH_CLASS_CAPS       0x2
+#define KH_CLASS_CTL        0x4
+#define KH_CLASSES          8
+/**@}*/
 
-#define KHS_SHIFT_CORE (key_state & (KH_LSHIFT_KEY | KH_RSHIFT_KEY)) 
-#define KHS_CTL_CORE (key_state & (KH_LCONTROL_KEY | KH_RCONTROL_KEY)) 
+/** Everything process_scancode() needs to know about one key. */
+typedef struct {
+  /** The raw result, KHE_UNDEFINED if we don't know the key */
+  unsigned char raw;
+  /** KH_RESULT_ bits of the result, besides KH_RESULT_MAKE */
+  unsigned char rmods;
+  /** key_state bits set while the key is down */
+  unsigned short hold;
+  /** key_state bits flipped every time the key goes down */
+  unsigned short toggle;
+  /** The result under each modifier class, 0 if there is no data */
+  unsigned char chars[KH_CLASSES];
+} key_entry_t;
 
-#define KHS_SHIFT(c,r,s,u) \
-  { c = KHS_SHIFT_CORE ? s : u; r = u; }
-#define KHS_SHIFTCTL(c,r,cc,s,u) \
-  { c = KHS_CTL_CORE ? cc : (KHS_SHIFT_CORE ? s : u); r = u; }
-#define KHS_SHIFTCAPSCTL(c,r,cc,s,u) \
-  { c = KHS_CTL_CORE ? cc : (((KHS_SHIFT_CORE || (key_state & KH_CAPS_LOCK)) && \
-    !(KHS_SHIFT_CORE && (key_state & KH_CAPS_LOCK))) ? s : u) ; r = u; }
+/**@{ Building blocks for the key tables */
+#define KH_DATA (KH_RESULT_HASRAW | KH_RESULT_HASDATA)
+  /** A key we have nothing for */
+#define KEY_UNDEFINED { KHE_UNDEFINED, KH_RESULT_HASRAW, 0, 0, { 0 } }
+  /** A key that means the same thing whatever the modifiers */
+#define KEY_PLAIN(u) \
+  { u, KH_DATA, 0, 0, { u, u, u, u, u, u, u, u } }
+  /** A key on the numeric pad */
+#define KEY_NUMPAD(u) \
+  { u, KH_DATA | KH_RESULT_NUMPAD, 0, 0, { u, u, u, u, u, u, u, u } }
+  /** A key that only shift changes */
+#define KEY_SHIFT(s, u) \
+  { u, KH_DATA, 0, 0, { u, s, u, s, u, s, u, s } }
+  /** A key that shift changes, and control overrides */
+#define KEY_SHIFTCTL(c, s, u) \
+  { u, KH_DATA, 0, 0, { u, s, u, s, c, c, c, c } }
+  /** A letter: shift or caps lock (but not both) change it, control
+   * overrides */
+#define KEY_SHIFTCAPSCTL(c, s, u) \
+  { u, KH_DATA, 0, 0, { u, s, s, u, c, c, c, c } }
+  /** A modifier key */
+#define KEY_HOLD(r, bit) { r, KH_RESULT_HASRAW, bit, 0, { 0 } }
+  /** A lock key */
+#define KEY_TOGGLE(r, bit) { r, KH_RESULT_HASRAW, 0, bit, { 0 } }
+/**@}*/
 
-/**
- * This function performs the mapping
- * from simple scancodes to chars.
- *
- * @param scancode a simple scancode.
- * @param pressed 0 if released, nonzero if pressed.
- *
- * @return A partially constructed kh_type.
- */
-static kh_type
-process_simple_scan(int scancode, int pressed)
-{
-  unsigned char code = 0x80;
-  unsigned char rcode = 0x80;
-  kh_type res = 0;
+/** Keys sent as a single scancode, indexed by the scancode without its
+ * break bit. */
+static const key_entry_t simple_keys[0x80] = {
+  [0 ... 0x7F] = KEY_UNDEFINED,
+  [0x01] = KEY_PLAIN(0x1B),                     /* Escape */
+  [0x02] = KEY_SHIFT('!', '1'),
+  [0x03] = KEY_SHIFTCTL(0x00, '@', '2'),
+  [0x04] = KEY_SHIFT('#', '3'),
+  [0x05] = KEY_SHIFT('$', '4'),
+  [0x06] = KEY_SHIFT('%', '5'),
+  [0x07] = KEY_SHIFTCTL(0x1E, '^', '6'),
+  [0x08] = KEY_SHIFT('&', '7'),
+  [0x09] = KEY_SHIFT('*', '8'),
+  [0x0A] = KEY_SHIFT('(', '9'),
+  [0x0B] = KEY_SHIFT(')', '0'),
+  [0x0C] = KEY_SHIFTCTL(0x1F, '_', '-'),
+  [0x0D] = KEY_SHIFT('+', '='),
+  [0x0E] = KEY_PLAIN('\b'),                     /* Backspace */
+  [0x0F] = KEY_PLAIN('\t'),                     /* Tab */
+  [0x10] = KEY_SHIFTCAPSCTL(0x11, 'Q', 'q'),
+  [0x11] = KEY_SHIFTCAPSCTL(0x17, 'W', 'w'),
+  [0x12] = KEY_SHIFTCAPSCTL(0x05, 'E', 'e'),
+  [0x13] = KEY_SHIFTCAPSCTL(0x12, 'R', 'r'),
+  [0x14] = KEY_SHIFTCAPSCTL(0x14, 'T', 't'),
+  [0x15] = KEY_SHIFTCAPSCTL(0x19, 'Y', 'y'),
+  [0x16] = KEY_SHIFTCAPSCTL(0x15, 'U', 'u'),
+  [0x17] = KEY_SHIFTCAPSCTL(0x09, 'I', 'i'),
+  [0x18] = KEY_SHIFTCAPSCTL(0x0F, 'O', 'o'),
+  [0x19] = KEY_SHIFTCAPSCTL(0x10, 'P', 'p'),
+  [0x1A] = KEY_SHIFTCAPSCTL(0x1B, '{', '['),
+  [0x1B] = KEY_SHIFTCAPSCTL(0x1D, '}', ']'),
+  [0x1C] = KEY_PLAIN('\n'),                     /* Enter */
+  [0x1D] = KEY_HOLD(KHE_LCTL, KH_LCONTROL_KEY),
+  [0x1E] = KEY_SHIFTCAPSCTL(0x01, 'A', 'a'),
+  [0x1F] = KEY_SHIFTCAPSCTL(0x13, 'S', 's'),
+  [0x20] = KEY_SHIFTCAPSCTL(0x04, 'D', 'd'),
+  [0x21] = KEY_SHIFTCAPSCTL(0x06, 'F', 'f'),
+  [0x22] = KEY_SHIFTCAPSCTL(0x07, 'G', 'g'),
+  [0x23] = KEY_SHIFTCAPSCTL(0x08, 'H', 'h'),
+  [0x24] = KEY_SHIFTCAPSCTL(0x0A, 'J', 'j'),
+  [0x25] = KEY_SHIFTCAPSCTL(0x0B, 'K', 'k'),
+  [0x26] = KEY_SHIFTCAPSCTL(0x0C, 'L', 'l'),
+  [0x27] = KEY_SHIFT(':', ';'),
+  [0x28] = KEY_SHIFT('\"', '\''),
+  [0x29] = KEY_SHIFT('~', '`'),
+  [0x2A] = KEY_HOLD(KHE_LSHIFT, KH_LSHIFT_KEY),
+  [0x2B] = KEY_SHIFTCTL(0x1C, '|', '\\'),
+  [0x2C] = KEY_SHIFTCAPSCTL(0x1A, 'Z', 'z'),
+  [0x2D] = KEY_SHIFTCAPSCTL(0x18, 'X', 'x'),
+  [0x2E] = KEY_SHIFTCAPSCTL(0x03, 'C', 'c'),
+  [0x2F] = KEY_SHIFTCAPSCTL(0x16, 'V', 'v'),
+  [0x30] = KEY_SHIFTCAPSCTL(0x02, 'B', 'b'),
+  [0x31] = KEY_SHIFTCAPSCTL(0x0E, 'N', 'n'),
+  [0x32] = KEY_SHIFTCAPSCTL(0x0D, 'M', 'm'),
+  [0x33] = KEY_SHIFT('<', ','),
+  [0x34] = KEY_SHIFT('>', '.'),
+  [0x35] = KEY_SHIFT('?', '/'),
+  [0x36] = KEY_HOLD(KHE_RSHIFT, KH_RSHIFT_KEY),
+  [0x37] = KEY_NUMPAD('*'),
+  [0x38] = KEY_HOLD(KHE_LALT, KH_LALT_KEY),
+  [0x39] = KEY_PLAIN(' '),                      /* Space bar */
+  [0x3A] = KEY_TOGGLE(KHE_CAPSLOCK, KH_CAPS_LOCK),
+  [0x3B] = KEY_PLAIN(KHE_F1),
+  [0x3C] = KEY_PLAIN(KHE_F2),
+  [0x3D] = KEY_PLAIN(KHE_F3),
+  [0x3E] = KEY_PLAIN(KHE_F4),
+  [0x3F] = KEY_PLAIN(KHE_F5),
+  [0x40] = KEY_PLAIN(KHE_F6),
+  [0x41] = KEY_PLAIN(KHE_F7),
+  [0x42] = KEY_PLAIN(KHE_F8),
+  [0x43] = KEY_PLAIN(KHE_F9),
+  [0x44] = KEY_PLAIN(KHE_F10),
+  [0x45] = KEY_TOGGLE(KHE_NUMLOCK, KH_NUM_LOCK),
+  [0x47] = KEY_NUMPAD('7'),
+  [0x48] = KEY_NUMPAD('8'),
+  [0x49] = KEY_NUMPAD('9'),
+  [0x4A] = KEY_NUMPAD('-'),
+  [0x4B] = KEY_NUMPAD('4'),
+  [0x4C] = KEY_NUMPAD('5'),
+  [0x4D] = KEY_NUMPAD('6'),
+  [0x4E] = KEY_NUMPAD('+'),
+  [0x4F] = KEY_NUMPAD('1'),
+  [0x50] = KEY_NUMPAD('2'),
+  [0x51] = KEY_NUMPAD('3'),
+  [0x52] = KEY_NUMPAD('0'),
+  [0x53] = KEY_NUMPAD('.'),
+  [0x57] = KEY_PLAIN(KHE_F11),
+  [0x58] = KEY_PLAIN(KHE_F12),
+};
 
-  switch(scancode & 0x7F)
-  {
-  case 0x1:
-    /* Escape key. */
-    rcode = code = 0x1B;
-    break;
-  case 0x2:
-    /* 1 or ! */
-    KHS_SHIFT(code, rcode, '!', '1');
-    break;
-  case 0x3:
-    /* 2 or @ */
-    KHS_SHIFTCTL(code, rcode, 0x00, '@', '2');
-    break;
-  case 0x4:
-    /* 3 or # */
-    KHS_SHIFT(code, rcode, '#', '3');
-    break;
-  case 0x5:
-    /* 4 or $ */
-    KHS_SHIFT(code, rcode, '$', '4');
-    break;
-  case 0x6:
-    /* 5 or % */
-    KHS_SHIFT(code, rcode, '%', '5');
-    break;
-  case 0x7:
-    /* 6 or ^ */
-    KHS_SHIFTCTL(code, rcode, 0x1E, '^', '6');
-    break;
-  case 0x8:
-    /* 7 or & */
-    KHS_SHIFT(code, rcode, '&', '7');
-    break;
-  case 0x9:
-    /* 8 or * */
-    KHS_SHIFT(code, rcode, '*', '8');
-    break;
-  case 0xA:
-    /* 9 or ( */
-    KHS_SHIFT(code, rcode, '(', '9');
-    break;
-  case 0xB:
-    /* 0 or ) */
-    KHS_SHIFT(code, rcode, ')', '0');
-    break;
-  case 0xC:
-    /* - or _ */
-    KHS_SHIFTCTL(code, rcode, 0x1F, '_', '-');
-    break;
-  case 0xD:
-    /* = or + */
-    KHS_SHIFT(code, rcode, '+', '=');
-    break;
-  case 0xE:
-    /* Backspace key. */
-    rcode = code = '\b';
-    break;
-  case 0xF:
-    /* Tab key. */
-    rcode = code = '\t';
-    break;
-  case 0x10:
-    /* q or Q. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x11, 'Q', 'q');
-    break;
-  case 0x11:
-    /* w or W. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x17, 'W', 'w');
-    break;
-  case 0x12:
-    /* e or E. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x05, 'E', 'e');
-    break;
-  case 0x13:
-    /* r or R. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x12, 'R', 'r');
-    break;
-  case 0x14:
-    /* t or T. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x14, 'T', 't');
-    break;
-  case 0x15:
-    /* y or Y. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x19, 'Y', 'y');
-    break;
-  case 0x16:
-    /* u or U. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x15, 'U', 'u');
-    break;
-  case 0x17:
-    /* i or I. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x09, 'I', 'i');
-    break;
-  case 0x18:
-    /* o or O. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0F, 'O', 'o');
-    break;
-  case 0x19:
-    /* p or P. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x10, 'P', 'p');
-    break;
-  case 0x1A:
-    /* [ or {. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x1B, '{', '[');
-    break;
-  case 0x1B:
-    /* ] or }. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x1D, '}', ']');
-    break;
-  case 0x1C:
-    /* Enter key. */
-    rcode=code='\n';
-    break;
-  case 0x1D:
-    if((key_internal_state & KH_PAUSE_SCAN) && (key_sequence == 0))
-    {
-      /* Stage 1 of a pause sequence */
-      key_sequence++;
-      return 0;
-    } else {
-      key_internal_state &= ~KH_PAUSE_SCAN;
-      key_sequence = 0;
-    }
-    rcode=KHE_LCTL;
-    if(pressed)
-      key_state |= KH_LCONTROL_KEY;
-    else
-      key_state &= ~KH_LCONTROL_KEY;
-    break;
-  case 0x1E:
-    /* a or A. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x01, 'A', 'a');
-    break;
-  case 0x1F:
-    /* s or S. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x13, 'S', 's');
-    break;
-  case 0x20:
-    /* d or D. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x04, 'D', 'd');
-    break;
-  case 0x21:
-    /* f or F. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x06, 'F', 'f');
-    break;
-  case 0x22:
-    /* g or G. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x07, 'G', 'g');
-    break;
-  case 0x23:
-    /* h or H. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x08, 'H', 'h');
-    break;
-  case 0x24:
-    /* j or J. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0A, 'J', 'j');
-    break;
-  case 0x25:
-    /* k or K. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0B, 'K', 'k');
-    break;
-  case 0x26:
-    /* l or L. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0C, 'L', 'l');
-    break;
-  case 0x27:
-    /* ; or :. */
-    KHS_SHIFT(code, rcode, ':', ';');
-    break;
-  case 0x28:
-    /* ' or " */
-    KHS_SHIFT(code, rcode, '\"', '\'');
-    break;
-  case 0x29:
-    KHS_SHIFT(code, rcode, '~', '`');
-    break;
-  case 0x2A:
-    rcode = KHE_LSHIFT;
-    if(pressed)
-      key_state |= KH_LSHIFT_KEY;
-    else
-      key_state &= ~KH_LSHIFT_KEY;
-    break;
-  case 0x2B:
-    /* \ or |. */
-    KHS_SHIFTCTL(code, rcode, 0x1C, '|', '\\');
-    break;
-  case 0x2C:
-    /* z or Z. */ 
-    KHS_SHIFTCAPSCTL(code, rcode, 0x1A, 'Z', 'z');
-    break;
-  case 0x2D:
-    /* x or X. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x18, 'X', 'x');
-    break;
-  case 0x2E:
-    /* c or C. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x03, 'C', 'c');
-    break;
-  case 0x2F:
-    /* v or V. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x16, 'V', 'v');
-    break;
-  case 0x30:
-    /* b or B. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x02, 'B', 'b');
-    break;
-  case 0x31:
-    /* n or N. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0E, 'N', 'n');
-    break;
-  case 0x32:
-    /* m or M. */
-    KHS_SHIFTCAPSCTL(code, rcode, 0x0D, 'M', 'm');
-    break;
-  case 0x33:
-    /* , or <. */
-    KHS_SHIFT(code, rcode, '<', ',');
-    break;
-  case 0x34:
-    /* . or >. */
-    KHS_SHIFT(code, rcode, '>', '.');
-    break;
-  case 0x35:
-    /* / or ? */
-    KHS_SHIFT(code, rcode, '?', '/');
-    break;
-  case 0x36:
-    rcode = KHE_RSHIFT;
-    if(pressed)
-      key_state |= KH_RSHIFT_KEY;
-    else
-      key_state &= ~KH_RSHIFT_KEY;
-    break;
-  case 0x37:
-    /* NP * */
-    rcode = code = '*';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x38:
-    rcode = KHE_LALT;
-    if(pressed)
-      key_state |= KH_LALT_KEY;
-    else
-      key_state &= ~KH_LALT_KEY;
-    break;
-  case 0x39:
-    /* Space bar. */
-    rcode = code =' ';
-    break;
-  case 0x3A:
-    rcode = KHE_CAPSLOCK;
-    if(pressed)
-    {
-      if(key_state & KH_CAPS_LOCK)
-        key_state &= ~KH_CAPS_LOCK;
-      else
-        key_state |= KH_CAPS_LOCK;
-    }
-    break;
-  case 0x3B:
-    /* F1 key. */
-    rcode = code = KHE_F1;
-    break;
-  case 0x3C:
-    /* F2 key. */
-    rcode = code = KHE_F2;
-    break;
-  case 0x3D:
-    /* F3 key. */
-    rcode = code = KHE_F3;
-    break;
-  case 0x3E:
-    /* F4 key. */
-    rcode = code = KHE_F4;
-    break;
-  case 0x3F:
-    /* F5 key. */
-    rcode = code = KHE_F5;
-    break;
-  case 0x40:
-    /* F6 key. */
-    rcode = code = KHE_F6;
-    break;
-  case 0x41:
-    /* F7 key. */
-    rcode = code = KHE_F7;
-    break;
-  case 0x42:
-    /* F8 key. */
-    rcode = code = KHE_F8;
-    break;
-  case 0x43:
-    /* F9 key. */
-    rcode = code = KHE_F9;
-    break;
-  case 0x44:
-    /* F10 key. */
-    rcode = code = KHE_F10;
-    break;
-  case 0x45:
-    if((key_internal_state & KH_PAUSE_SCAN) && (key_sequence == 1))
-    {
-      /* Stage 2 of a pause sequence */
-      key_sequence++;
-      return 0;
-    } else {
-      key_internal_state &= ~KH_PAUSE_SCAN;
-      key_sequence = 0;
-    }
-    rcode = KHE_NUMLOCK;
-    if(pressed)
-    {
-      if(key_state & KH_NUM_LOCK)
-        key_state &= ~KH_NUM_LOCK;
-      else
-        key_state |= KH_NUM_LOCK;
-    }
-    break;
-  case 0x47:
-    rcode = code = '7';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x48:
-    rcode = code = '8';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x49:
-    rcode = code = '9';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4A:
-    rcode = code = '-';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4B:
-    rcode = code = '4';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4C:
-    rcode = code = '5';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4D:
-    rcode = code = '6';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4E:
-    rcode = code = '+';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x4F:
-    rcode = code = '1';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x50:
-    rcode = code = '2';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x51:
-    rcode = code = '3';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x52:
-    rcode = code = '0';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x53:
-    rcode = code = '.';
-    res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-    break;
-  case 0x57:
-    /* F11 key. */
-    rcode = code = KHE_F11;
-    break;
-  case 0x58:
-    /* F12 key. */
-    rcode = code = KHE_F12;
-    break;
-  case 0xE1 & 0x7F:
-    if(!(key_internal_state & KH_PAUSE_SCAN))
-    {
-      /* Stage 0 of a pause sequence */
-      key_internal_state |= KH_PAUSE_SCAN;
-      key_sequence = 0;
-      return 0;
-    } else if ((key_internal_state & KH_PAUSE_SCAN) && (key_sequence == 2)) {
-      key_sequence++;
-      return 0;
-    } else {
-      key_internal_state &= ~KH_PAUSE_SCAN;
-      key_sequence = 0;
-    }
-    /* FALLTHROUGH */
-  default:
-    rcode = code = KHE_UNDEFINED;
-    break;
-  }
+/** Keys sent with an E0 prefix, indexed by the scancode after it without
+ * its break bit.  0x2A and 0x37 are only looked up once the PRINT SCREEN
+ * machine has seen the rest of the sequence. */
+static const key_entry_t extended_keys[0x80] = {
+  [0 ... 0x7F] = KEY_UNDEFINED,
+  [0x1C] = KEY_NUMPAD('\n'),
+  [0x1D] = KEY_HOLD(KHE_RCTL, KH_RCONTROL_KEY),
+  [0x2A] = KEY_PLAIN(KHE_PRINT_SCREEN),
+  [0x35] = KEY_NUMPAD('/'),
+  [0x37] = KEY_PLAIN(KHE_PRINT_SCREEN),
+  [0x38] = KEY_HOLD(KHE_RALT, KH_RALT_KEY),
+  [0x48] = KEY_PLAIN(KHE_ARROW_UP),
+  [0x49] = KEY_PLAIN(KHE_PAGE_UP),
+  [0x4B] = KEY_PLAIN(KHE_ARROW_LEFT),
+  [0x4D] = KEY_PLAIN(KHE_ARROW_RIGHT),
+  [0x50] = KEY_PLAIN(KHE_ARROW_DOWN),
+  [0x51] = KEY_PLAIN(KHE_PAGE_DOWN),
+  [0x53] = KEY_PLAIN(0x7F),                     /* DEL */
+};
 
-  if ( rcode != KHE_UNDEFINED && code != KHE_UNDEFINED )
-    res |= (KH_RESULT_HASDATA << KH_RMODS_SHIFT);
-  else
-    code = 0x00;
+/**@{ What a byte does to the sequence it is part of */
+  /** Not part of it; decode the byte as usual */
+#define SEQ_PASS            0
+  /** An intermediate byte; the result only has the make bit and state */
+#define SEQ_CONSUME         1
+  /** An intermediate byte whose result is entirely empty */
+#define SEQ_CONSUME_EMPTY   2
+  /** The last byte of a PAUSE sequence */
+#define SEQ_PAUSE           3
+/**@}*/
 
-  return res | (code << KH_CHAR_SHIFT)
-            | (rcode << KH_RAWCHAR_SHIFT)
-            | (KH_RESULT_HASRAW << KH_RMODS_SHIFT);
-}
+/** A transition of one of the sequence state machines */
+typedef struct {
+  unsigned char next;
+  unsigned char action;
+} seq_step_t;
+
+/**@{ PAUSE sends E1 1D 45 E1 9D C5; the stage is how many have arrived.
+ * Bytes of other classes leave a sequence in progress alone, and a byte of
+ * the wrong class abandons it and is decoded as usual.  E1 and 61 are the
+ * same as far as the sequence cares. */
+#define PAUSE_STAGES        6
+#define PAUSE_OTHER         0
+#define PAUSE_E1            1
+#define PAUSE_1D            2
+#define PAUSE_45            3
+#define PAUSE_9D            4
+#define PAUSE_C5            5
+#define PAUSE_CLASSES       6
+/**@}*/
+
+/** Class of every byte outside of an extended sequence. */
+static const unsigned char pause_class[0x100] = {
+  [0x1D] = PAUSE_1D,
+  [0x45] = PAUSE_45,
+  [0x61] = PAUSE_E1,
+  [0x9D] = PAUSE_9D,
+  [0xC5] = PAUSE_C5,
+  [0xE1] = PAUSE_E1,
+};
+
+/** PAUSE transitions, indexed by [stage][class]. */
+static const seq_step_t pause_steps[PAUSE_STAGES][PAUSE_CLASSES] = {
+  /* OTHER, E1, 1D, 45, 9D, C5 */
+  { { 0, SEQ_PASS }, { 1, SEQ_CONSUME }, { 0, SEQ_PASS },
+    { 0, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS } },
+  { { 1, SEQ_PASS }, { 0, SEQ_PASS }, { 2, SEQ_CONSUME },
+    { 0, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS } },
+  { { 2, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS },
+    { 3, SEQ_CONSUME }, { 0, SEQ_PASS }, { 0, SEQ_PASS } },
+  { { 3, SEQ_PASS }, { 4, SEQ_CONSUME }, { 0, SEQ_PASS },
+    { 0, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS } },
+  { { 4, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS },
+    { 0, SEQ_PASS }, { 5, SEQ_CONSUME_EMPTY }, { 0, SEQ_PASS } },
+  { { 5, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PASS },
+    { 0, SEQ_PASS }, { 0, SEQ_PASS }, { 0, SEQ_PAUSE } },
+};
+
+/**@{ PRINT SCREEN sends E0 2A E0 37 down and E0 B7 E0 AA up.  The state is
+ * which half of which one has arrived; any byte decoded outside of an
+ * extended sequence forgets it. */
+#define PRSCR_NONE          0
+#define PRSCR_DOWN          1
+#define PRSCR_UP            2
+#define PRSCR_STATES        3
+#define PRSCR_OTHER         0
+#define PRSCR_2A            1
+#define PRSCR_37            2
+#define PRSCR_CLASSES       3
+/**@}*/
+
+/** Class of every byte in an extended sequence, without its break bit. */
+static const unsigned char prscr_class[0x80] = {
+  [0x2A] = PRSCR_2A,
+  [0x37] = PRSCR_37,
+};
+
+/** PRINT SCREEN transitions, indexed by [state][class]. */
+static const seq_step_t prscr_steps[PRSCR_STATES][PRSCR_CLASSES] = {
+  /* OTHER, 2A, 37 */
+  { { PRSCR_NONE, SEQ_PASS }, { PRSCR_DOWN, SEQ_CONSUME },
+    { PRSCR_UP, SEQ_CONSUME } },
+  { { PRSCR_DOWN, SEQ_PASS }, { PRSCR_DOWN, SEQ_CONSUME },
+    { PRSCR_NONE, SEQ_PASS } },
+  { { PRSCR_UP, SEQ_PASS }, { PRSCR_NONE, SEQ_PASS },
+    { PRSCR_UP, SEQ_CONSUME } },
+};
+
+static unsigned char pause_stage = 0;
+static unsigned char prscr_state = PRSCR_NONE;
 
 /**
- * Processes extended scan codes.  Notably, this includes
- * the arrow keys as well as some of the more unusual keys
- * on the keyboard.
+ * Looks a key up and updates key_state for it.
  *
- * @param keypress the extended scancode.
- * @param 0 if released. non-zero if pressed.
+ * @param key the key's table entry.
+ * @param pressed 0 if released, 1 if pressed.
  *
  * @return A partially constructed kh_type.
  */
-kh_type
-process_extended_scan(int keypress, int pressed)
+static kh_type
+decode_key(const key_entry_t *key, int pressed)
 {
-  unsigned char code = 0x80;
-  unsigned char rcode = 0x80;
-  kh_type res = 0;
-
-  /* Intermediate states in multiple byte scancodes should return
-   * zero from this function, rather than returning a RESULT code.
-   */
+  int class =
+      (KH_CLASS_SHIFT * !!(key_state & (KH_LSHIFT_KEY | KH_RSHIFT_KEY)))
+    | (KH_CLASS_CAPS * !!(key_state & KH_CAPS_LOCK))
+    | (KH_CLASS_CTL * !!(key_state & (KH_LCONTROL_KEY | KH_RCONTROL_KEY)));
+  kh_type res = (key->chars[class] << KH_CHAR_SHIFT)
+              | (key->raw << KH_RAWCHAR_SHIFT)
+              | (key->rmods << KH_RMODS_SHIFT);
 
-  switch(keypress & 0x7F)
-  {
-    case 0x1C:
-      /* NP '\n' */
-      rcode = code = '\n';
-      res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-      break;
-    case 0x1D:
-      /* Right control key */
-      rcode = KHE_RCTL;
-      if(pressed)
-        key_state |= KH_RCONTROL_KEY;
-      else
-        key_state &= ~KH_RCONTROL_KEY;
-      break;
-    case 0x2A:
-      /* Stage 0 of PRINT SCREEN MAKE and Stage 1 of PRINT SCREEN BREAK */
-      if(key_internal_state & KH_PRSCR_UP_SCAN)
-      {
-        rcode = code = KHE_PRINT_SCREEN;
-        key_internal_state &= ~KH_PRSCR_UP_SCAN;
-      } else if (!(key_internal_state & KH_PRSCR_UP_SCAN)) {
-        key_internal_state |= KH_PRSCR_DOWN_SCAN;
-        key_internal_state &= ~KH_EXTENDED_SCAN;
-        return 0;
-      } else {
-        rcode = code = KHE_UNDEFINED;
-      }
-      break;
-    case 0x35:
-      /* NP / */
-      rcode = code = '/';
-      res |= KH_RESULT_NUMPAD << KH_RMODS_SHIFT;
-      break;
-    case 0x37:
-      /* Stage 1 of PRINT SCREEN MAKE and Stage 0 of PRINT SCREEN BREAK */
-      if(key_internal_state & KH_PRSCR_DOWN_SCAN)
-      {
-        rcode = code = KHE_PRINT_SCREEN;
-        key_internal_state &= ~KH_PRSCR_DOWN_SCAN;
-      } else if (!(key_internal_state & KH_PRSCR_DOWN_SCAN)) {
-        key_internal_state |= KH_PRSCR_UP_SCAN;
-        key_internal_state &= ~KH_EXTENDED_SCAN;
-        return 0;
-      } else {
-        rcode = code = KHE_UNDEFINED;
-      }
-      break;
-    case 0x38:
-      /* Right alt key */
-      rcode = KHE_RALT;
-      if(pressed)
-        key_state |= KH_RALT_KEY;
-      else
-        key_state &= ~KH_RALT_KEY;
-      break;
-    case 0x48:
-      /* UP */
-      rcode = code=KHE_ARROW_UP;
-      break;
-    case 0x4b:
-      /* LEFT */
-      rcode = code=KHE_ARROW_LEFT;
-      break;
-    case 0x4d:
-      /* RIGHT */
-      rcode = code=KHE_ARROW_RIGHT;
-      break;
-    case 0x50:
-      /* DOWN */
-      rcode = code = KHE_ARROW_DOWN;
-      break;
-    case 0x53:
-      /* DEL */
-      rcode = code = 0x7F;
-      break;
-    default:
-      rcode = code = KHE_UNDEFINED;
-      break;
-  }
-
-  key_internal_state &= ~KH_EXTENDED_SCAN;
-
-  if ( rcode != KHE_UNDEFINED && code != KHE_UNDEFINED )
-    res |= (KH_RESULT_HASDATA << KH_RMODS_SHIFT);
-  else
-    code = 0x00;
-
-  return res | (code << KH_CHAR_SHIFT)
-            | (rcode << KH_RAWCHAR_SHIFT)
-            | (KH_RESULT_HASRAW << KH_RMODS_SHIFT);
+  key_state = (key_state & ~key->hold) | (key->hold & -pressed);
+  key_state ^= key->toggle & -pressed;
+  return res;
 }
 
   /** The entrypoint to the keyboard processing library.
@@ -603,49 +329,49 @@ kh_type process_scancode(int keypress) {
   kh_type res;
   int pressed = !(keypress & 0x80);
   int keycode = keypress & 0x7F;
-  
-  if (key_internal_state & KH_EXTENDED_SCAN)
-    res = process_extended_scan(keycode, pressed);
+  const seq_step_t *step;
+
+  if (key_extended)
+  {
+    key_extended = 0;
+    step = &prscr_steps[prscr_state][prscr_class[keycode]];
+    prscr_state = step->next;
+    if (step->action == SEQ_CONSUME)
+      res = 0;
+    else
+      res = decode_key(&extended_keys[keycode], pressed);
+  }
+  else if ((keypress & 0xFF) == 0xE0)
+  {
+    key_extended = 1;
+    /* Return no result for this intermediate state */
+    return key_state << KH_STATE_SHIFT;
+  }
   else
   {
-    switch(keypress & 0xFF)
+    step = &pause_steps[pause_stage][pause_class[keypress & 0xFF]];
+    pause_stage = step->next;
+    switch (step->action)
     {
-      case 0x9D:
-        if ((key_internal_state & KH_PAUSE_SCAN) && (key_sequence == 3))
-        {
-          key_sequence++;
-          return 0;
-        } else {
-          key_internal_state &= ~KH_PAUSE_SCAN;
-          key_sequence = 0;
-        }
-        goto deflt;
-      case 0xC5:
-        if ((key_internal_state & KH_PAUSE_SCAN) && (key_sequence == 4))
-        {
-          key_internal_state &= ~KH_PAUSE_SCAN;
-          /* Pause sequence completed */
-          res = (KHE_PAUSE << KH_CHAR_SHIFT)
-                | (KHE_PAUSE << KH_RAWCHAR_SHIFT)
-                | (KH_RESULT_HASDATA << KH_RMODS_SHIFT);
-          break;
-        }
-        key_internal_state &= ~KH_PAUSE_SCAN;
-        key_sequence = 0;
-        goto deflt;
-      case 0xE0:
-        key_internal_state |= KH_EXTENDED_SCAN;
-        /* Return no result for this intermediate state */
-        return key_state << KH_STATE_SHIFT;
+      case SEQ_CONSUME_EMPTY:
+        return 0;
+      case SEQ_PAUSE:
+        res = (KHE_PAUSE << KH_CHAR_SHIFT)
+              | (KHE_PAUSE << KH_RAWCHAR_SHIFT)
+              | (KH_RESULT_HASDATA << KH_RMODS_SHIFT);
+        break;
+      case SEQ_CONSUME:
+        prscr_state = PRSCR_NONE;
+        res = 0;
+        break;
       default:
-deflt:
-        key_internal_state &= ~(KH_PRSCR_UP_SCAN | KH_PRSCR_DOWN_SCAN);
-        res = process_simple_scan(keycode, pressed);
+        prscr_state = PRSCR_NONE;
+        res = decode_key(&simple_keys[keycode], pressed);
+        break;
     }
   }
 
-  if(pressed)
-    res |= KH_RESULT_MAKE << KH_RMODS_SHIFT;
+  res |= (pressed * KH_RESULT_MAKE) << KH_RMODS_SHIFT;
 
   res |= (key_state & KH_STATE_SMASK) << KH_STATE_SHIFT;
 
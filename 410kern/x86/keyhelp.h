@@ -185,6 +185,10 @@ enum kh_extended_e {
   KHE_PAUSE,
   KHE_PRINT_SCREEN,
 
+  /* Paging keys */
+  KHE_PAGE_UP,
+  KHE_PAGE_DOWN,
+
   /** 
    * @bug Coming soon...
    * Well now, THIS is going to be a fun case.  Since we SHOULD move to
@@ -200,8 +204,6 @@ enum kh_extended_e {
   /* KHE_HOME, */
   /* KHE_END, */
   /* KHE_INSERT, */
-  /* KHE_PAGE_UP, */
-  /* KHE_PAGE_DOWN, */
   /* KHE_APPS, */ /* The "context menu" key */
 };
 
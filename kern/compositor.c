@@ -0,0 +1,114 @@
+/** @file compositor.c
+ *  @brief frame pacing implementation
+ *
+ *  Frames are counted off the timer with an accumulator: each tick adds the
+ *  frame rate to it, and whenever it reaches TICKS_PER_SECOND a frame starts
+ *  and that much is taken back off. Any rate up to the tick rate works this
+ *  way without needing to divide it evenly.
+ *
+ *  Sources draw into the console's shadows from the main loop, and a flush
+ *  from the tick could land halfway through one of them, so while somebody
+ *  is presenting, the tick only starts frames. compositor_present() flushes
+ *  instead, once every source for the frame has run, so a frame reaches the
+ *  screen whole. Plenty of code never presents at all, though: anything that
+ *  runs before a source is registered, or a kernel that just prints and
+ *  spins. So the tick still flushes a frame itself when no source is
+ *  registered, or when the frame before it went by without a present.
+ *
+ *  Submitting a source just sets its bit in pending, so a burst of keypresses
+ *  between two frames costs one present and one flush, not one per key.
+ *  compositor_present() takes the whole mask in one go with interrupts off
+ *  and then presents from its copy, so a source submitted while it runs is
+ *  picked up by the next frame.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug described in compositor.h
+ */
+#include <stddef.h>     /* NULL */
+#include <stdint.h>     /* uint32_t */
+#include <asm.h>        /* disable_interrupts() */
+#include <eflags.h>     /* get_eflags(), set_eflags() */
+#include <timer.h>      /* TICKS_PER_SECOND */
+#include <console.h>    /* console_flush() */
+
+#include <compositor.h>
+
+static int rate = COMPOSITOR_DEFAULT_RATE;
+static int accumulator = 0;
+/* frames started by the timer, and the last one compositor_present() saw */
+static volatile unsigned int frames_started = 0;
+static volatile unsigned int frames_presented = 0;
+
+static void (*sources[COMPOSITOR_MAX_SOURCES])(void);
+static int num_sources = 0;
+/* one bit per source that has changes for the next frame */
+static volatile uint32_t pending = 0;
+
+int compositor_set_rate(int hz)
+{
+    if (hz <= 0 || hz > TICKS_PER_SECOND) {
+        return -1;
+    }
+    rate = hz;
+    return 0;
+}
+
+int compositor_register(void (*present)(void))
+{
+    if (present == NULL || num_sources == COMPOSITOR_MAX_SOURCES) {
+        return -1;
+    }
+    sources[num_sources] = present;
+    return num_sources++;
+}
+
+void compositor_submit(int source)
+{
+    if (source < 0 || source >= num_sources) {
+        return;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    pending |= (1 << source);
+    set_eflags(eflags);
+}
+
+void compositor_tick(void)
+{
+    accumulator += rate;
+    if (accumulator < TICKS_PER_SECOND) {
+        return;
+    }
+    accumulator -= TICKS_PER_SECOND;
+    frames_started++;
+    /* the last frame was never presented, so nobody is going to flush this */
+    if (num_sources == 0 || frames_started - frames_presented > 1) {
+        console_flush();
+    }
+}
+
+int compositor_present(void)
+{
+    if (frames_presented == frames_started) {
+        return 0;
+    }
+    frames_presented = frames_started;
+
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    uint32_t todo = pending;
+    pending = 0;
+    set_eflags(eflags);
+
+    int presented = 0;
+    int source;
+    for (source = 0; source < num_sources; source++) {
+        if (todo & (1 << source)) {
+            sources[source]();
+            presented++;
+        }
+    }
+    /* everything drawn for this frame goes out together */
+    console_flush();
+    return presented;
+}
@@ -0,0 +1,69 @@
+/** @file compositor.h
+ *  @brief frame pacing interface
+ *
+ *  Interface for putting everything that gets drawn onto the screen at a
+ *  fixed frame rate instead of as soon as it's drawn. Text written to the
+ *  console piles up in its shadows until compositor_present() flushes it,
+ *  after every source for the frame has drawn, or until the timer tick
+ *  flushes it because no one presented the frame before. Anything else that
+ *  has to be turned into pixels, like the tile renderer, registers as a
+ *  source and submits itself whenever what it shows changes; the main loop
+ *  presents every source that was submitted once per frame, no matter how
+ *  many times it was submitted in between.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug The timer ticks at 100Hz, so frames are spaced 1 or 2 ticks apart at
+ *       60Hz and 3 or 4 ticks apart at 30Hz. They average out to the right
+ *       rate but are never perfectly even.
+ */
+#ifndef __COMPOSITOR_H_
+#define __COMPOSITOR_H_
+
+/* frame rate used until compositor_set_rate() says otherwise */
+#define COMPOSITOR_DEFAULT_RATE 60
+
+/* most sources that can be registered */
+#define COMPOSITOR_MAX_SOURCES  8
+
+/** @brief sets how many frames a second are put on screen
+ *
+ *  @param hz frames per second, from 1 up to the timer's TICKS_PER_SECOND
+ *  @return 0 on success, negative if hz is out of range
+ */
+int compositor_set_rate(int hz);
+/** @brief registers something that draws into a frame
+ *
+ *  @param present function that puts the source's changes on screen, called
+ *         from compositor_present() at most once a frame
+ *  @return id to pass to compositor_submit(), or negative if present is NULL
+ *          or there are too many sources
+ */
+int compositor_register(void (*present)(void));
+/** @brief marks a source as having changes for the next frame
+ *
+ *  Safe to call from interrupt handlers.
+ *
+ *  @param source id returned by compositor_register()
+ *  @return Void.
+ */
+void compositor_submit(int source);
+/** @brief counts a timer tick, starting a frame if one is due
+ *
+ *  If no source is registered, or the last frame went by without a
+ *  compositor_present(), the new frame is flushed right here.
+ *
+ *  @pre called from the timer handler
+ *  @return Void.
+ */
+void compositor_tick(void);
+/** @brief presents every submitted source, if a frame has started since
+ *
+ *  Called from the main loop as often as it likes; it does nothing until
+ *  the timer starts the next frame. Once the sources have run, the console
+ *  is flushed, so everything drawn since the last frame shows up at once.
+ *
+ *  @return number of sources presented
+ */
+int compositor_present(void);
+
+#endif /* __COMPOSITOR_H_ */
@@ -4,259 +4,1961 @@
  *  Implementation for console driver. Has all logic for displaying text back to
  *  the console.
  *
+ *  Nothing in here writes to VGA memory directly. Every write goes into an
+ *  in-RAM shadow of the screen and marks its row as dirty. console_flush()
+ *  later compares each dirty row against what it last copied out to VGA memory
+ *  and only copies the span of cells that differs. VGA memory is uncached and
+ *  every access to it is expensive under virtualization, so this turns dozens
+ *  of single cell MMIO writes per keypress into a couple of small copies.
+ *
+ *  Scrolling doesn't move any memory either. The shadow is a ring of rows with
+ *  shadow_top being the first visible one, so scrolling just advances
+ *  shadow_top and blanks the row that comes into view. VGA text memory is 32KB,
+ *  which is a lot more than one screen, so it's treated as a ring of rows too:
+ *  a flush moves the CRTC start address down by however many lines we
+ *  scrolled, and only the newly exposed rows have to be written. When the
+ *  visible window would run off the end of the console's region of VGA
+ *  memory, it jumps back to the start and the whole screen is rewritten there
+ *  once.
+ *
+ *  Rows that scroll off the top are kept in a malloc()ed history ring once
+ *  console_scrollback_init() has been called. Every line ever output has an
+ *  absolute line number; the screen shows geom.height lines starting at
+ *  either the live top line or some older line while scrolled back. Moving the
+ *  view is handled exactly like scrolling, just possibly backwards: the CRTC
+ *  start address moves and only rows that came into view get copied.
+ *
+ *  The cursor is only tracked in software. Every CRTC port access traps out to
+ *  the hypervisor, so the hardware cursor is only programmed at flush points
+ *  (every console_flush() and console_sync_cursor()), after any pending
+ *  scroll has moved the start address the cursor is counted from, and then
+ *  only the halves of the cursor address that actually changed are written.
+ *
+ *  There are CONSOLE_COUNT virtual consoles, each a vconsole_t holding all of
+ *  the state above. Output goes to whichever one out points at, and only the
+ *  shown one ever gets flushed. VGA memory is split into a region per console
+ *  and each console scrolls within its own region, so a hidden console's rows
+ *  are still in VGA memory when it's switched back to.
+ *
+ *  The size of the screen is only known at runtime, since console_set_mode()
+ *  can switch the VGA into a text mode with more rows and columns. Every
+ *  buffer is sized for the largest mode, and rows of the history are always
+ *  CONSOLE_MAX_WIDTH cells apart, whatever geom.width is.
+ *
+ *  The shadow doubles as the copy of the screen that get_char()/get_cell()
+ *  read, since VGA memory is uncached and slow to read. Its rows are padded
+ *  out to SHADOW_STRIDE cells so that every row starts on a cache line, and
+ *  the cells around any one cell sit in the fewest lines they can.
+ *
+ *  Text written with putbyte()/putbytes() can carry a subset of VT100 escape
+ *  sequences (cursor movement, SGR colors, erasing, saving the cursor), so a
+ *  whole colored screen can go out in one putbytes() call instead of a string
+ *  of set_cursor()/set_term_color() calls.
+ *
+ *  Every row also remembers how long the line of text on it is, so '\b' at
+ *  the start of a row can go straight back to where the previous line ended.
+ *  Like the dirty flags, the lengths belong to shadow rows, so scrolling moves
+ *  them along for free and only the row coming into view is reset.
+ *
  *  @author Bradley Zhou (bradleyz)
- *  @bug '\b' isn't handled perfectly. If we are typing some text onto a line
- *       and partway through, we press '\n' to move onto the next line, the
- *       console doesn't "remember" where the last position was on the previous
- *       line, so if we press backspace immediately after that, the cursor will
- *       move to the last character in the previous line (which is most likely
- *       an empty space) instead of the position right before the '\n'.
+ *  @bug Only text written through putbyte()/putbytes() counts towards a row's
+ *       line length. Cells drawn with draw_char() and friends past the end of
+ *       the line are skipped over by '\b' instead of being erased.
  */
 #include <p1kern.h>
 #include <stddef.h>     /* NULL */
 #include <stdbool.h>    /* bool */
 #include <stdint.h>     /* uint8_t, uint16_t */
-#include <string.h>     /* memmove() */
-#include <asm.h>        /* outb() */
+#include <string.h>     /* memcpy(), memset(), strncmp(), ... */
+#include <malloc.h>     /* malloc() */
+#include <asm.h>        /* outb(), disable_interrupts(), rdtsc() */
+#include <eflags.h>     /* get_eflags(), set_eflags(), EFL_IF */
+
+#include <console.h>
+#include <console_asm.h>
+#include <vga.h>
+#include <serial.h>     /* serial_init(), serial_write() */
+#if defined(CONSOLE_BENCHMARK) || defined(CONSOLE_STATS)
+#include <simics.h>     /* lprintf() */
+#endif
 
 /* ASCII code for space character */
 #define ASCII_SPACE 0x20
+/* ASCII code for the escape character that starts an escape sequence */
+#define ASCII_ESC   0x1B
+
+/* most parameters of a CSI sequence we keep, any more are ignored */
+#define CSI_MAX_PARAMS  8
+/* parameters are clamped to this so they can't overflow while parsing */
+#define CSI_MAX_VALUE   9999
+
+/* pull the character/color back out of a cell made with CONSOLE_CELL() */
+#define CELL_CHAR(cell)     ((char)((cell) & 0xFF))
+#define CELL_COLOR(cell)    (((cell) >> 8) & 0xFF)
+/* what the screen is assumed to be filled with before anything is drawn */
+#define BLANK_CELL          CONSOLE_CELL(ASCII_SPACE, FGND_WHITE | BGND_BLACK)
+
+/* bytes in a cache line, and cells in a shadow row rounded up to fill lines */
+#define CACHE_LINE_SIZE     64
+#define LINE_CELLS          (CACHE_LINE_SIZE / (int)sizeof(uint16_t))
+#define SHADOW_STRIDE \
+    ((CONSOLE_MAX_WIDTH + LINE_CELLS - 1) / LINE_CELLS * LINE_CELLS)
+
+/* CRTC registers holding the address VGA memory is displayed from */
+#define CRTC_START_ADDR_MSB_IDX 12
+#define CRTC_START_ADDR_LSB_IDX 13
+/* size of the VGA text memory window at CONSOLE_MEM_BASE in bytes */
+#define CONSOLE_MEM_SIZE        0x8000
+/* number of whole rows that fit into VGA text memory in the current mode */
+#define VGA_ROWS (CONSOLE_MEM_SIZE / (2 * geom.width))
+/* most rows there can be, since no mode is narrower than the one we boot in */
+#define VGA_MAX_ROWS (CONSOLE_MEM_SIZE / (2 * CONSOLE_WIDTH))
+/**
+ *  VGA memory is split into this many regions, one per console if they fit.
+ *  Each needs at least a screen's worth of rows, plus some spare ones to
+ *  scroll through the CRTC start address with. The taller modes end up with
+ *  fewer regions than consoles.
+ */
+#define VGA_REGIONS \
+    (CONSOLE_COUNT < VGA_ROWS / (2 * geom.height) ? \
+     CONSOLE_COUNT : VGA_ROWS / (2 * geom.height))
+/* number of rows of VGA memory in each region */
+#define REGION_ROWS (VGA_ROWS / VGA_REGIONS)
+
+/* address of a cell in VGA memory, where row counts from the start of memory */
+#define VGA_CELL(row, col) \
+    ((uint16_t*)CONSOLE_MEM_BASE + (row) * geom.width + (col))
+
+/* color the console starts out with and SGR 0 goes back to */
+#define DEFAULT_COLOR (FGND_WHITE | BGND_BLACK)
+/* parts of a color byte */
+#define COLOR_FGND_MASK     0x07
+#define COLOR_BRIGHT        0x08
+#define COLOR_BGND_MASK     0x70
+#define COLOR_BGND_SHIFT    4
+
+/* where we are in an escape sequence being written to the console */
+typedef enum {
+    ESC_NONE,       /* not in an escape sequence, characters are printed */
+    ESC_START,      /* just got ESC */
+    ESC_CSI,        /* got ESC [, reading parameters up to the final byte */
+    ESC_IGNORE,     /* in a CSI sequence we don't support, skipping it */
+} esc_state_t;
+
+/* state of one virtual console */
+typedef struct {
+    /**
+     *  in-RAM copy of the screen; all writes to the console land here. Sized
+     *  for the largest mode, only the top left geom.height by geom.width cells
+     *  are used.
+     */
+    uint16_t shadow[CONSOLE_MAX_HEIGHT][SHADOW_STRIDE]
+        __attribute__((aligned(CACHE_LINE_SIZE)));
+    /* index into shadow of the row currently at the top of the screen */
+    int shadow_top;
+    /* shadow rows that were written to since the last flush */
+    bool row_dirty[CONSOLE_MAX_HEIGHT];
+    /**
+     *  length of the line of text on each shadow row, i.e. the column just
+     *  past the last character putbyte() left there; geom.width if the line
+     *  wrapped onto the next row
+     */
+    int line_len[CONSOLE_MAX_HEIGHT];
+    /* whether any row is dirty at all, so an idle flush is O(1) */
+    bool dirty;
+    /* total lines scrolled so far, i.e. absolute line number of the top row */
+    unsigned int lines_scrolled;
+
+    /* ring of lines of CONSOLE_MAX_WIDTH cells that scrolled off the top */
+    uint16_t *history;
+    /* number of lines the history ring can hold */
+    int history_size;
+    /* number of lines currently in the history ring */
+    int history_count;
+    /* index into history the next line to scroll off will be saved at */
+    int history_next;
+
+    /* whether the view is scrolled back into history instead of live output */
+    bool viewing_history;
+    /* absolute line number shown in the top row while viewing history */
+    unsigned int view_line;
+    /* whether the view moved since the last flush */
+    bool view_moved;
+
+    /* color new characters are written with */
+    int color;
+    /* where the next character goes */
+    int cursor_row;
+    int cursor_col;
+    /* whether the cursor is shown while this console is on screen */
+    bool cursor_shown;
+
+    /* escape sequence parser state */
+    esc_state_t esc_state;
+    /* parameters of the CSI sequence being parsed, 0 if left out */
+    int csi_params[CSI_MAX_PARAMS];
+    /* index of the parameter currently being read */
+    int csi_param;
+    /* cursor and color saved by ESC 7 or CSI s */
+    int saved_row;
+    int saved_col;
+    int saved_color;
+
+    /* bumped by every clear, so text posted for the old screen is dropped */
+    unsigned int epoch;
+} vconsole_t;
+
+/* part of VGA memory set aside for displaying virtual consoles */
+typedef struct {
+    /* row within the region the CRTC starts displaying from when shown */
+    int origin;
+    /* absolute line number of the owner shown in the row at origin */
+    unsigned int line;
+    /* index of the console whose rows the region holds, -1 if none */
+    int owner;
+} vga_region_t;
+
+/* size of the screen in the current text mode, 80x25 until it's changed */
+static console_geometry_t geom = {
+    .width = CONSOLE_WIDTH,
+    .height = CONSOLE_HEIGHT,
+};
+
+/* all of the virtual consoles */
+static vconsole_t consoles[CONSOLE_COUNT] = {
+    [0 ... CONSOLE_COUNT - 1] = {
+        .shadow = {
+            [0 ... CONSOLE_MAX_HEIGHT - 1] = {
+                [0 ... SHADOW_STRIDE - 1] = BLANK_CELL
+            }
+        },
+        .color = DEFAULT_COLOR,
+        .cursor_shown = true,
+        .saved_color = DEFAULT_COLOR,
+    }
+};
+/* console that putbytes(), draw_char(), etc. write to */
+static vconsole_t *out = &consoles[0];
+/* console that is on screen */
+static vconsole_t *shown = &consoles[0];
+
+/* what we last copied out to VGA memory, so flushing never reads from MMIO */
+static uint16_t vga_copy[VGA_MAX_ROWS][CONSOLE_MAX_WIDTH];
+/* rows of vga_copy that are known to match VGA memory */
+static bool vga_row_valid[VGA_MAX_ROWS];
+/* VGA memory split up between the consoles */
+static vga_region_t regions[CONSOLE_COUNT] = {
+    [0 ... CONSOLE_COUNT - 1] = { .owner = -1 }
+};
+/* whether to scroll through the CRTC start address or by rewriting rows */
+static bool hw_scroll = true;
+
+/* halves of the cursor address last written to the CRTC, -1 if never */
+static int hw_cursor_msb = -1;
+static int hw_cursor_lsb = -1;
+
+/* text mode the VGA is in, NULL while it's still the BIOS's 80x25 */
+static const vga_text_mode_t *text_mode = NULL;
+/* whether someone else has the VGA, so nothing may be flushed to it */
+static bool vga_released = false;
 
-/* global variables keeping track of the state of the console/cursor */
-int console_color = (FGND_WHITE | BGND_BLACK);
-int cursor_row = 0;
-int cursor_col = 0;
-bool cursor_shown = true;
+/* number of slots in the ring of posted text, a power of two */
+#define POST_SLOTS 16
+
+/* text posted by console_post_text(), waiting to be drawn */
+typedef struct {
+    int console;                    /* index of the console to draw on */
+    unsigned int epoch;             /* epoch of that console when posted */
+    int row;
+    int col;
+    int color;
+    int len;                        /* number of characters in text */
+    char text[CONSOLE_POST_MAX];
+} posted_text_t;
+
+/**
+ *  Ring of posted text, with a single producer and a single consumer and no
+ *  locking on either side. Only console_post_text() writes post_head: it
+ *  fills in a slot and then publishes it with one store to post_head. Only
+ *  console_drain_posted() writes post_tail, the same way. Each side only
+ *  reads the other's index, and an aligned word store is atomic on x86, so
+ *  neither ever sees a slot half handed over. Both count up forever and are
+ *  masked to index the ring.
+ */
+static posted_text_t post_ring[POST_SLOTS];
+static volatile unsigned int post_head = 0;
+static volatile unsigned int post_tail = 0;
+
+/* keeps the compiler from moving memory accesses across it */
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/**
+ *  Ring holding the last CONSOLE_LOG_SIZE bytes sent to the log sink, oldest
+ *  overwritten first. log_head counts every byte ever logged and is masked to
+ *  index the ring.
+ */
+static char log_ring[CONSOLE_LOG_SIZE];
+static unsigned int log_head = 0;
+
+/* something putbyte()/putbytes() can send their bytes to */
+typedef struct {
+    const char *name;                       /* name in the sink list */
+    int (*init)(void);                      /* NULL if nothing to set up */
+    void (*write)(const char *s, int len);  /* takes bytes, never blocks */
+} sink_t;
+
+/* bit in enabled_sinks of each entry of sinks[], VGA only to start with */
+static unsigned int enabled_sinks = 1;
+
+#ifdef CONSOLE_STATS
+/* cycle counts of every call to one function */
+typedef struct {
+    unsigned int calls;
+    uint64_t total;
+    uint64_t max;
+} stat_timer_t;
+
+/* everything console_stats_dump() reports */
+static struct {
+    unsigned int chars;         /* bytes passed to write_char() */
+    unsigned int scrolls;       /* lines scrolled */
+    unsigned int crtc_writes;   /* outb()s to the CRTC index/data ports */
+    unsigned int clears;        /* clear_console()/console_clear() calls */
+    unsigned int draw_chars;    /* draw_char() calls */
+    unsigned int bytes_flushed; /* bytes copied out to VGA memory */
+    stat_timer_t putbytes;
+    stat_timer_t clear;
+    stat_timer_t scroll;
+} stats;
+
+/** @brief adds one call that started at the given cycle count to a timer
+ *
+ *  @param timer timer to add the call to
+ *  @param start cycle count the call started at
+ *  @return Void.
+ */
+static void stat_time(stat_timer_t *timer, uint64_t start)
+{
+    uint64_t cycles = rdtsc() - start;
+    timer->calls++;
+    timer->total += cycles;
+    if (cycles > timer->max) {
+        timer->max = cycles;
+    }
+}
+
+#define STAT_ADD(counter, n)        (stats.counter += (n))
+#define STAT_TIME_START(start)      uint64_t start = rdtsc()
+#define STAT_TIME_END(timer, start) stat_time(&stats.timer, start)
+#else
+/* without CONSOLE_STATS none of the counting is even compiled in */
+#define STAT_ADD(counter, n)        ((void)0)
+#define STAT_TIME_START(start)
+#define STAT_TIME_END(timer, start) ((void)0)
+#endif /* CONSOLE_STATS */
+#define STAT_INC(counter)           STAT_ADD(counter, 1)
 
 /** @brief checks if row/col are in range of the console
  *
- *  Compares row and col with CONSOLE_HEIGHT and CONSOLE_WIDTH.
+ *  Compares row and col with geom.height and geom.width.
  *
  *  @return if the row and col are in range of the console
  */
 static bool in_range(int row, int col)
 {
-    return row >= 0 && row < CONSOLE_HEIGHT && col >= 0 && col < CONSOLE_WIDTH;
+    return row >= 0 && row < geom.height && col >= 0 && col < geom.width;
 }
 
-/** @brief scrolls the console up one line
+/** @brief finds the shadow row that is displayed at a given screen row
+ *
+ *  @param vc console to look in
+ *  @param row row on the screen
+ *  @return index of that row in the console's shadow
+ */
+static inline int shadow_index(vconsole_t *vc, int row)
+{
+    int index = vc->shadow_top + row;
+    if (index >= geom.height) {
+        index -= geom.height;
+    }
+    return index;
+}
+
+/** @brief marks a row of the shadow as needing to be flushed
  *
- *  Moves the memory from rows [1, CONSOLE_HEIGHT) to [0, CONSOLE_HEIGHT - 1)
- *  and flushes the botttom line of the console with all spaces, clearing it.
+ *  The cell itself has to be written before calling this. A flush that sneaks
+ *  in between the two then just copies the new cell a tick early, and the row
+ *  gets looked at once more next time.
  *
+ *  @param vc console that was written to
+ *  @param row row that was written to
  *  @return Void.
  */
-static void scroll()
+static inline void mark_dirty(vconsole_t *vc, int row)
 {
-    memmove((void*)CONSOLE_MEM_BASE,
-            /* start from row 1 */
-            (void*)(CONSOLE_MEM_BASE + 2 * CONSOLE_WIDTH),
-            /* amount of bytes from CONSOLE_HEIGHT - 1 lines */
-            (2 * (CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH));
+    vc->row_dirty[shadow_index(vc, row)] = true;
+    vc->dirty = true;
+}
 
-    char *last_row = (char*)(CONSOLE_MEM_BASE +
-                             (2 * (CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH));
-    char *limit = last_row + (2 * CONSOLE_WIDTH);
-    while (last_row < limit) {
-        last_row[0] = ASCII_SPACE;
-        /* write every two bytes beacuse we don't want to overwrite color */
-        last_row += 2;
+/** @brief marks every row of the shadow as needing to be flushed
+ *
+ *  @param vc console to mark
+ *  @return Void.
+ */
+static void mark_all_dirty(vconsole_t *vc)
+{
+    int row;
+    for (row = 0; row < geom.height; row++) {
+        vc->row_dirty[row] = true;
     }
+    vc->dirty = true;
 }
 
-/** @brief all logic for putbyte() just without setting the cursor immediately
+/** @brief clips a rectangle to the screen
  *
- *  The motivation behind this function is because the most obvious approach for
- *  putbytes() is to just call putbyte() a number of times. However, my
- *  implementation for putbyte() sets the cursor immediately. Therefore, the
- *  obvious putbytes() implementation would call set_cursor() an unnecessary
- *  amount of times. Pulling out the logic into write_char() means we can just
- *  call set_cursor() once in putbytes().
+ *  Cuts off whatever part of the rectangle lies outside the console, moving
+ *  its top left corner onto the screen if need be.
  *
- *  '\b' at the start of a line will start deleting characters from the previous
- *  line. If we are at the start of of the line at the first row and we get a
- *  '\b', then nothing happens.
- *
- *  @param ch character to write to console
+ *  @param row pointer to the top row of the rectangle
+ *  @param col pointer to the left column of the rectangle
+ *  @param height pointer to the number of rows in the rectangle
+ *  @param width pointer to the number of columns in the rectangle
+ *  @param skip_rows where to store how many rows were cut off the top
+ *  @param skip_cols where to store how many columns were cut off the left
+ *  @return whether any part of the rectangle is left on screen
  */
-static void write_char( char ch )
+static bool clip_rect(int *row, int *col, int *height, int *width,
+                      int *skip_rows, int *skip_cols)
 {
-    char *write_addr;
-    if (ch == '\r') {
-        cursor_col = 0;
+    *skip_rows = 0;
+    *skip_cols = 0;
+    if (*row < 0) {
+        *skip_rows = -*row;
+        *height += *row;
+        *row = 0;
     }
-    else if (ch == '\n') {
-        cursor_col = 0;
-        /* scroll if we called '\n' when we're on the last line */
-        if (cursor_row == CONSOLE_HEIGHT - 1) {
-            scroll();
-        }
-        else {
-            cursor_row++;
-        }
+    if (*col < 0) {
+        *skip_cols = -*col;
+        *width += *col;
+        *col = 0;
     }
-    else if (ch == '\b') {
-        /* "normal" case where we can just write a space over prev character */
-        if (cursor_col > 0) {
-            cursor_col--;
-        }
-        else {
-            if (cursor_row == 0) {
-                return;
-            }
-            cursor_row--;
-            cursor_col = CONSOLE_WIDTH - 1;
-        }
-        write_addr = (char*)(CONSOLE_MEM_BASE +
-                     2 * (cursor_row * CONSOLE_WIDTH + cursor_col));
-        write_addr[0] = ASCII_SPACE;
-        write_addr[1] = console_color;
+    if (*row + *height > geom.height) {
+        *height = geom.height - *row;
     }
-    else {
-        write_addr = (char*)(CONSOLE_MEM_BASE +
-                     2 * (cursor_row * CONSOLE_WIDTH + cursor_col));
-        write_addr[0] = ch;
-        write_addr[1] = console_color;
-        /* increment the cursor position, next row/scrolling if necessary */
-        if (cursor_col < CONSOLE_WIDTH - 1) {
-            cursor_col++;
-        }
-        else {
-            cursor_col = 0;
-            if (cursor_row == CONSOLE_HEIGHT - 1) {
-                scroll();
-            }
-            else {
-                cursor_row++;
-            }
-        }
+    if (*col + *width > geom.width) {
+        *width = geom.width - *col;
     }
+    return *height > 0 && *width > 0;
 }
 
-int putbyte( char ch )
+/** @brief fills a run of cells with the same value
+ *
+ *  Stores two cells at a time with rep stosl, with at most one single cell
+ *  store at either end to get onto a 4 byte boundary.
+ *
+ *  @param dst first cell to fill
+ *  @param cell value to fill with
+ *  @param n number of cells to fill
+ *  @return Void.
+ */
+static void fill_cells(uint16_t *dst, uint16_t cell, int n)
 {
-    write_char(ch);
-    set_cursor(cursor_row, cursor_col);
-    return ch;
+    if (n <= 0) {
+        return;
+    }
+    if ((uintptr_t)dst & 2) {
+        *dst++ = cell;
+        n--;
+    }
+    if (n >= 2) {
+        fill_dwords((uint32_t*)dst, ((uint32_t)cell << 16) | cell, n / 2);
+        dst += n & ~1;
+    }
+    if (n & 1) {
+        *dst = cell;
+    }
 }
 
-void putbytes( const char *s, int len )
+/** @brief replaces the characters of a run of cells with spaces
+ *
+ *  The colors are left alone, so every cell has to be read back. This works
+ *  on two cells at a time, masking the color bytes out of a dword and putting
+ *  two spaces in, unrolled so the loop overhead is paid once per 8 cells.
+ *
+ *  @param dst first cell to blank
+ *  @param n number of cells to blank
+ *  @return Void.
+ */
+static void blank_cells(uint16_t *dst, int n)
 {
-    if (len <= 0 || s == NULL) {
+    const uint32_t colors = 0xFF00FF00;
+    const uint32_t spaces = (ASCII_SPACE << 16) | ASCII_SPACE;
+
+    if (n <= 0) {
         return;
     }
-
-    int i;
-    for (i = 0; i < len; i++) {
-        /* break early if we reach null terminator */
-        if (s[i] == '\0') {
-            break;
-        }
-        write_char(s[i]);
+    if ((uintptr_t)dst & 2) {
+        *dst = CONSOLE_CELL(ASCII_SPACE, CELL_COLOR(*dst));
+        dst++;
+        n--;
+    }
+    uint32_t *pair = (uint32_t*)dst;
+    uint32_t *end = pair + n / 2;
+    while (end - pair >= 4) {
+        pair[0] = (pair[0] & colors) | spaces;
+        pair[1] = (pair[1] & colors) | spaces;
+        pair[2] = (pair[2] & colors) | spaces;
+        pair[3] = (pair[3] & colors) | spaces;
+        pair += 4;
     }
+    while (pair < end) {
+        *pair = (*pair & colors) | spaces;
+        pair++;
+    }
+    if (n & 1) {
+        dst = (uint16_t*)pair;
+        *dst = CONSOLE_CELL(ASCII_SPACE, CELL_COLOR(*dst));
+    }
+}
 
-    set_cursor(cursor_row, cursor_col);
+/** @brief writes a single cell into the shadow
+ *
+ *  @param vc console to write to
+ *  @param row row of the cell
+ *  @param col column of the cell
+ *  @param ch character to write
+ *  @param color color to write
+ *  @return Void.
+ */
+static inline void put_cell(vconsole_t *vc, int row, int col,
+                            char ch, int color)
+{
+    vc->shadow[shadow_index(vc, row)][col] = CONSOLE_CELL(ch, color);
+    mark_dirty(vc, row);
 }
 
-int set_term_color( int color )
+/** @brief finds the cells of a line by its absolute line number
+ *
+ *  @pre line has to be either on the live screen or still in history
+ *  @param vc console to look in
+ *  @param line absolute line number
+ *  @return pointer to the geom.width cells of that line
+ */
+static uint16_t *screen_line(vconsole_t *vc, unsigned int line)
 {
-    /* considering blink in color range */
-    if ((unsigned int)color > 0xFF) {
-        return -1;
+    if (line >= vc->lines_scrolled) {
+        return vc->shadow[shadow_index(vc, line - vc->lines_scrolled)];
     }
-    console_color = color;
-    return 0;
+    int index = vc->history_next - (int)(vc->lines_scrolled - line);
+    if (index < 0) {
+        index += vc->history_size;
+    }
+    return &vc->history[index * CONSOLE_MAX_WIDTH];
 }
 
-void get_term_color( int *color )
+/** @brief finds the region of VGA memory a console is displayed from
+ *
+ *  @param vc console to look up
+ *  @return region of VGA memory set aside for that console
+ */
+static inline vga_region_t *region_of(vconsole_t *vc)
 {
-    *color = console_color;
+    return &regions[(vc - consoles) % VGA_REGIONS];
 }
 
-int set_cursor( int row, int col )
+/** @brief finds where a region starts in VGA memory
+ *
+ *  @param region region to look up
+ *  @return first row of VGA memory in the region
+ */
+static inline int region_first_row(vga_region_t *region)
 {
-    if (!in_range(row, col)) {
-        return -1;
-    }
-    cursor_row = row;
-    cursor_col = col;
+    return (region - regions) * REGION_ROWS;
+}
+
+/** @brief copies the changed span of one row on screen out to VGA memory
+ *
+ *  Trims matching cells off both ends of the row by comparing against
+ *  vga_copy, then copies only what's left. A row of VGA memory we haven't
+ *  written before has unknown contents, so it gets copied whole.
+ *
+ *  @param row row on the screen to flush
+ *  @return Void.
+ */
+static void flush_row(int row)
+{
+    vga_region_t *region = region_of(shown);
+    int vga_row = region_first_row(region) + region->origin + row;
+    uint16_t *src = screen_line(shown, region->line + row);
+    uint16_t *known = vga_copy[vga_row];
+    int lo = 0;
+    int hi = geom.width;
 
-    if (cursor_shown) {
-        show_cursor();
+    if (vga_row_valid[vga_row]) {
+        while (lo < hi && src[lo] == known[lo]) {
+            lo++;
+        }
+        while (hi > lo && src[hi - 1] == known[hi - 1]) {
+            hi--;
+        }
+        if (lo == hi) {
+            return;
+        }
     }
 
-    return 0;
+    memcpy(&known[lo], &src[lo], (hi - lo) * sizeof(uint16_t));
+    memcpy(VGA_CELL(vga_row, lo), &src[lo], (hi - lo) * sizeof(uint16_t));
+    vga_row_valid[vga_row] = true;
+    STAT_ADD(bytes_flushed, (hi - lo) * sizeof(uint16_t));
 }
 
-void get_cursor( int *row, int *col )
+void console_crtc_write(uint8_t index, uint8_t value)
 {
-    *row = cursor_row;
-    *col = cursor_col;
+    outb(CRTC_IDX_REG, index);
+    outb(CRTC_DATA_REG, value);
+    STAT_ADD(crtc_writes, 2);
 }
 
-void hide_cursor(void)
+/** @brief points the CRTC at the row of VGA memory to start displaying from
+ *
+ *  @return Void.
+ */
+static void set_start_address(void)
 {
-    cursor_shown = false;
+    if (vga_released) {
+        return;
+    }
+    vga_region_t *region = region_of(shown);
+    uint16_t addr = (uint16_t)((region_first_row(region) + region->origin) *
+                               geom.width);
 
-    uint16_t addr = (uint16_t)(CONSOLE_HEIGHT * CONSOLE_WIDTH);
-    uint8_t top_half = (addr >> 8) & 0xFF;
-    uint8_t bottom_half = addr & 0xFF;
+    console_crtc_write(CRTC_START_ADDR_MSB_IDX, (addr >> 8) & 0xFF);
+    console_crtc_write(CRTC_START_ADDR_LSB_IDX, addr & 0xFF);
+}
 
-    /* writes cursor to just out of range of the console */
-    outb(CRTC_IDX_REG, CRTC_CURSOR_MSB_IDX);
-    outb(CRTC_DATA_REG, top_half);
-    outb(CRTC_IDX_REG, CRTC_CURSOR_LSB_IDX);
-    outb(CRTC_DATA_REG, bottom_half);
+/** @brief absolute line number that should be shown in the top row
+ *
+ *  Also pulls the view back into range if the history it was looking at has
+ *  since been overwritten.
+ *
+ *  @param vc console to look at
+ *  @return absolute line number of the top row
+ */
+static unsigned int top_line(vconsole_t *vc)
+{
+    if (!vc->viewing_history) {
+        return vc->lines_scrolled;
+    }
+    unsigned int oldest = vc->lines_scrolled - vc->history_count;
+    if ((int)(vc->view_line - oldest) < 0) {
+        vc->view_line = oldest;
+    }
+    return vc->view_line;
 }
 
-void show_cursor(void)
+/** @brief catches VGA memory up on the lines scrolled since the last flush
+ *
+ *  Every row already in the shown console's region of VGA memory is still
+ *  valid, it's just displayed some lines higher or lower now, so with hardware
+ *  scrolling moving the start address is all it takes; the rows that came
+ *  into view are dirty and get written by the flush. Only if the screen would
+ *  run past either end of the region do we compact by jumping to the far end,
+ *  which leaves the most room to keep scrolling the same way. Whenever the
+ *  start address didn't move by exactly the number of lines scrolled, the
+ *  shadow and VGA memory are out of step and every row has to be looked at
+ *  again.
+ *
+ *  @return Void.
+ */
+static void apply_pending_scroll(void)
 {
-    cursor_shown = true;
+    vga_region_t *region = region_of(shown);
+    unsigned int line = top_line(shown);
+    int delta = (int)(line - region->line);
+    int new_origin = region->origin + delta;
+    if (!hw_scroll) {
+        new_origin = 0;
+    }
+    else if (new_origin < 0) {
+        new_origin = REGION_ROWS - geom.height;
+    }
+    else if (new_origin + geom.height > REGION_ROWS) {
+        new_origin = 0;
+    }
+
+    if (new_origin - region->origin != delta) {
+        mark_all_dirty(shown);
+    }
+    region->line = line;
+
+    if (new_origin != region->origin) {
+        region->origin = new_origin;
+        set_start_address();
+    }
+}
 
-    uint16_t addr = cursor_row * CONSOLE_WIDTH + cursor_col;
+/** @brief programs the hardware cursor to match the shown console's cursor
+ *
+ *  The cursor is addressed from the start of VGA memory, so it moves whenever
+ *  the start address does. While the view is scrolled back into history the
+ *  cursor's row isn't on screen, so it's hidden. Each half of the address is
+ *  only written if it differs from what the CRTC already holds, so calling
+ *  this when nothing moved costs no port I/O at all.
+ *
+ *  @pre interrupts are disabled, so the index/data writes can't be interleaved
+ *       with the ones from a flush
+ *  @return Void.
+ */
+static void sync_cursor(void)
+{
+    if (vga_released) {
+        return;
+    }
+    vga_region_t *region = region_of(shown);
+    int start_row = region_first_row(region) + region->origin;
+    uint16_t addr;
+    if (shown->cursor_shown && !shown->viewing_history) {
+        addr = (start_row + shown->cursor_row) * geom.width +
+               shown->cursor_col;
+    }
+    else {
+        /* just out of range of the console */
+        addr = (uint16_t)((start_row + geom.height) * geom.width);
+    }
     uint8_t top_half = (addr >> 8) & 0xFF;
     uint8_t bottom_half = addr & 0xFF;
 
-    outb(CRTC_IDX_REG, CRTC_CURSOR_MSB_IDX);
-    outb(CRTC_DATA_REG, top_half);
-    outb(CRTC_IDX_REG, CRTC_CURSOR_LSB_IDX);
-    outb(CRTC_DATA_REG, bottom_half);
+    if (top_half != hw_cursor_msb) {
+        console_crtc_write(CRTC_CURSOR_MSB_IDX, top_half);
+        hw_cursor_msb = top_half;
+    }
+    if (bottom_half != hw_cursor_lsb) {
+        console_crtc_write(CRTC_CURSOR_LSB_IDX, bottom_half);
+        hw_cursor_lsb = bottom_half;
+    }
 }
 
-void clear_console(void)
+/** @brief makes sure the shown console's region of VGA memory holds its rows
+ *
+ *  With more consoles than regions, consoles share regions. When the shown
+ *  console's region last held some other console, none of what's there can
+ *  be trusted, so the screen is placed at the start of the region and every
+ *  row is marked to be copied over in full.
+ *
+ *  @return whether the region had to be taken over, which moves the start
+ *          address
+ */
+static bool claim_region(void)
 {
-    register char *curr = (char*)CONSOLE_MEM_BASE;
-    char *end = (char*)(CONSOLE_MEM_BASE +
-                        (2 * CONSOLE_HEIGHT * CONSOLE_WIDTH));
-    /* only write every two bytes because we don't want to overwrite color */
-    while (curr < end) {
-        curr[0] = ASCII_SPACE;
-        curr += 2;
+    vga_region_t *region = region_of(shown);
+    int index = shown - consoles;
+    if (region->owner == index) {
+        return false;
     }
-    cursor_row = 0;
-    cursor_col = 0;
-    if (cursor_shown) {
-        show_cursor();
+    int first_row = region_first_row(region);
+    int row;
+    for (row = 0; row < REGION_ROWS; row++) {
+        vga_row_valid[first_row + row] = false;
     }
+    region->owner = index;
+    region->origin = 0;
+    region->line = top_line(shown);
+    mark_all_dirty(shown);
+    return true;
 }
 
-void draw_char( int row, int col, int ch, int color )
+/** @brief flushes right away if no frame is going to come along and do it
+ *
+ *  Output written with interrupts disabled (early boot, panic()) would
+ *  otherwise never make it onto the screen.
+ *
+ *  @return Void.
+ */
+static inline void flush_if_no_tick(void)
 {
-    if (!in_range(row, col)) {
-        return;
+    if (!(get_eflags() & EFL_IF)) {
+        console_flush();
     }
-    if ((unsigned int)color > 0xFF) {
-        return;
+}
+
+/** @brief scrolls the console up one line
+ *
+ *  Saves the top row into history, then advances shadow_top so the old top
+ *  row becomes the new bottom row and fills it with spaces, clearing it.
+ *  Nothing else is moved; VGA memory catches up at the next flush.
+ *
+ *  @param vc console to scroll
+ *  @return Void.
+ */
+static void scroll(vconsole_t *vc)
+{
+    STAT_TIME_START(start);
+    /* a flush in the middle would see shadow_top and lines_scrolled disagree */
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    uint16_t *last_row = vc->shadow[vc->shadow_top];
+    if (vc->history != NULL) {
+        memcpy(&vc->history[vc->history_next * CONSOLE_MAX_WIDTH], last_row,
+               geom.width * sizeof(uint16_t));
+        if (++vc->history_next == vc->history_size) {
+            vc->history_next = 0;
+        }
+        if (vc->history_count < vc->history_size) {
+            vc->history_count++;
+        }
     }
-    char *write_addr = (char*)(CONSOLE_MEM_BASE +
-                               2 * (row * CONSOLE_WIDTH + col));
-    write_addr[0] = ch;
-    write_addr[1] = color;
+    vc->shadow_top = shadow_index(vc, 1);
+
+    /* keep the color that was already there */
+    blank_cells(last_row, geom.width);
+    vc->line_len[shadow_index(vc, geom.height - 1)] = 0;
+    mark_dirty(vc, geom.height - 1);
+    vc->lines_scrolled++;
+
+    set_eflags(eflags);
+    STAT_INC(scrolls);
+    STAT_TIME_END(scroll, start);
 }
 
-char get_char( int row, int col )
+/** @brief blanks part of a row with the current color
+ *
+ *  @param vc console to write to
+ *  @param row row to blank
+ *  @param col first column to blank
+ *  @param n number of cells to blank
+ *  @return Void.
+ */
+static void erase_cells(vconsole_t *vc, int row, int col, int n)
+{
+    int index = shadow_index(vc, row);
+    fill_cells(&vc->shadow[index][col], CONSOLE_CELL(ASCII_SPACE, vc->color),
+               n);
+    mark_dirty(vc, row);
+    /* the line only gets shorter if everything after col went */
+    if (col + n >= geom.width && vc->line_len[index] > col) {
+        vc->line_len[index] = col;
+    }
+}
+
+/** @brief clamps a value into a range
+ *
+ *  @param value value to clamp
+ *  @param lo smallest value allowed
+ *  @param hi largest value allowed
+ *  @return value, moved into [lo, hi] if it was outside of it
+ */
+static inline int clamp(int value, int lo, int hi)
+{
+    if (value < lo) {
+        return lo;
+    }
+    if (value > hi) {
+        return hi;
+    }
+    return value;
+}
+
+/** @brief applies the parameters of an SGR (CSI ... m) sequence
+ *
+ *  Supports resetting (0), bright/normal intensity (1/22), blink on/off
+ *  (5/25), the 8 foreground and background colors (30-37/40-47), their bright
+ *  variants (90-97/100-107, where a bright background is the blink bit), and
+ *  default foreground/background (39/49). Anything else is ignored.
+ *
+ *  @param vc console whose color to change
+ *  @param count number of parameters given
+ *  @return Void.
+ */
+static void apply_sgr(vconsole_t *vc, int count)
+{
+    int color = vc->color;
+    int i;
+    for (i = 0; i < count; i++) {
+        int param = vc->csi_params[i];
+        if (param == 0) {
+            color = DEFAULT_COLOR;
+        }
+        else if (param == 1) {
+            color |= COLOR_BRIGHT;
+        }
+        else if (param == 22) {
+            color &= ~COLOR_BRIGHT;
+        }
+        else if (param == 5) {
+            color |= BLINK;
+        }
+        else if (param == 25) {
+            color &= ~BLINK;
+        }
+        else if (param >= 30 && param <= 37) {
+            color = (color & ~COLOR_FGND_MASK) | CONSOLE_ANSI_COLOR(param - 30);
+        }
+        else if (param == 39) {
+            color = (color & ~(COLOR_FGND_MASK | COLOR_BRIGHT)) |
+                    (DEFAULT_COLOR & (COLOR_FGND_MASK | COLOR_BRIGHT));
+        }
+        else if (param >= 40 && param <= 47) {
+            color = (color & ~COLOR_BGND_MASK) |
+                    (CONSOLE_ANSI_COLOR(param - 40) << COLOR_BGND_SHIFT);
+        }
+        else if (param == 49) {
+            color = (color & ~(COLOR_BGND_MASK | BLINK)) |
+                    (DEFAULT_COLOR & (COLOR_BGND_MASK | BLINK));
+        }
+        else if (param >= 90 && param <= 97) {
+            color = (color & ~COLOR_FGND_MASK) | COLOR_BRIGHT |
+                    CONSOLE_ANSI_COLOR(param - 90);
+        }
+        else if (param >= 100 && param <= 107) {
+            color = (color & ~COLOR_BGND_MASK) | BLINK |
+                    (CONSOLE_ANSI_COLOR(param - 100) << COLOR_BGND_SHIFT);
+        }
+    }
+    vc->color = color;
+}
+
+/** @brief carries out a complete CSI sequence
+ *
+ *  Supported final bytes:
+ *  H/f: move the cursor to row;col, counting from 1 like VT100 does
+ *  A/B/C/D: move the cursor up/down/right/left by a number of cells
+ *  J: erase from the cursor to the end of the screen (0), from the start of
+ *     the screen to the cursor (1), or the whole screen (2)
+ *  K: same as J but only within the cursor's row
+ *  m: set colors, see apply_sgr()
+ *  s/u: save/restore the cursor position
+ *  Moves are clamped to the screen, and anything else is ignored.
+ *
+ *  @param vc console the sequence was written to
+ *  @param final final byte of the sequence, which says what to do
+ *  @return Void.
+ */
+static void do_csi(vconsole_t *vc, char final)
+{
+    int count = vc->csi_param + 1;
+    int mode = vc->csi_params[0];
+    /* a left out or zero count means one for cursor movement */
+    int n = mode > 0 ? mode : 1;
+    int col = vc->csi_params[1] > 0 ? vc->csi_params[1] : 1;
+    int cur_row = vc->cursor_row;
+    int cur_col = vc->cursor_col;
+    int row;
+
+    switch (final) {
+        case 'H':
+        case 'f':
+            vc->cursor_row = clamp(n, 1, geom.height) - 1;
+            vc->cursor_col = clamp(col, 1, geom.width) - 1;
+            break;
+        case 'A':
+            vc->cursor_row = clamp(cur_row - n, 0, geom.height - 1);
+            break;
+        case 'B':
+            vc->cursor_row = clamp(cur_row + n, 0, geom.height - 1);
+            break;
+        case 'C':
+            vc->cursor_col = clamp(cur_col + n, 0, geom.width - 1);
+            break;
+        case 'D':
+            vc->cursor_col = clamp(cur_col - n, 0, geom.width - 1);
+            break;
+        case 'J':
+            if (mode == 0) {
+                erase_cells(vc, cur_row, cur_col, geom.width - cur_col);
+                for (row = cur_row + 1; row < geom.height; row++) {
+                    erase_cells(vc, row, 0, geom.width);
+                }
+            }
+            else if (mode == 1) {
+                for (row = 0; row < cur_row; row++) {
+                    erase_cells(vc, row, 0, geom.width);
+                }
+                erase_cells(vc, cur_row, 0, cur_col + 1);
+            }
+            else if (mode == 2) {
+                for (row = 0; row < geom.height; row++) {
+                    erase_cells(vc, row, 0, geom.width);
+                }
+            }
+            break;
+        case 'K':
+            if (mode == 0) {
+                erase_cells(vc, cur_row, cur_col, geom.width - cur_col);
+            }
+            else if (mode == 1) {
+                erase_cells(vc, cur_row, 0, cur_col + 1);
+            }
+            else if (mode == 2) {
+                erase_cells(vc, cur_row, 0, geom.width);
+            }
+            break;
+        case 'm':
+            apply_sgr(vc, count);
+            break;
+        case 's':
+            vc->saved_row = cur_row;
+            vc->saved_col = cur_col;
+            break;
+        case 'u':
+            vc->cursor_row = vc->saved_row;
+            vc->cursor_col = vc->saved_col;
+            break;
+        default:
+            break;
+    }
+}
+
+/** @brief feeds one character of an escape sequence to the parser
+ *
+ *  Besides CSI sequences (ESC [ params final), ESC 7 and ESC 8 save and
+ *  restore the cursor position together with the color, like on a VT100. An
+ *  ESC followed by anything else is dropped along with that character.
+ *
+ *  @pre vc->esc_state isn't ESC_NONE
+ *  @param vc console the sequence is written to
+ *  @param ch next character of the sequence
+ *  @return Void.
+ */
+static void parse_escape(vconsole_t *vc, char ch)
+{
+    if (vc->esc_state == ESC_START) {
+        vc->esc_state = ESC_NONE;
+        if (ch == '[') {
+            int i;
+            for (i = 0; i < CSI_MAX_PARAMS; i++) {
+                vc->csi_params[i] = 0;
+            }
+            vc->csi_param = 0;
+            vc->esc_state = ESC_CSI;
+        }
+        else if (ch == '7') {
+            vc->saved_row = vc->cursor_row;
+            vc->saved_col = vc->cursor_col;
+            vc->saved_color = vc->color;
+        }
+        else if (ch == '8') {
+            vc->cursor_row = vc->saved_row;
+            vc->cursor_col = vc->saved_col;
+            vc->color = vc->saved_color;
+        }
+        return;
+    }
+
+    if (ch >= '@' && ch <= '~') {
+        /* final byte ends the sequence */
+        if (vc->esc_state == ESC_CSI) {
+            do_csi(vc, ch);
+        }
+        vc->esc_state = ESC_NONE;
+    }
+    else if (ch < ASCII_SPACE) {
+        /* a control character in the middle of a sequence cancels it */
+        vc->esc_state = ESC_NONE;
+    }
+    else if (vc->esc_state == ESC_IGNORE) {
+        return;
+    }
+    else if (ch >= '0' && ch <= '9') {
+        int value = vc->csi_params[vc->csi_param] * 10 + (ch - '0');
+        vc->csi_params[vc->csi_param] = clamp(value, 0, CSI_MAX_VALUE);
+    }
+    else if (ch == ';') {
+        if (vc->csi_param < CSI_MAX_PARAMS - 1) {
+            vc->csi_param++;
+        }
+    }
+    else {
+        /* private ('?') or intermediate bytes, none of which we support */
+        vc->esc_state = ESC_IGNORE;
+    }
+}
+
+/** @brief writes a single character to the console at the cursor
+ *
+ *  Only moves the software cursor. The hardware cursor catches up at the next
+ *  flush point, so a string of characters costs no port I/O until then.
+ *
+ *  '\b' at the start of a row goes back to where the line on the previous row
+ *  ended. If that line wrapped onto this row, its last character is deleted,
+ *  otherwise '\b' just undoes the '\n' and deletes nothing. If we are at the
+ *  start of the first row and we get a '\b', then nothing happens.
+ *
+ *  ESC starts an escape sequence, and nothing is printed until it ends; see
+ *  parse_escape().
+ *
+ *  @param vc console to write to
+ *  @param ch character to write to console
+ */
+static void write_char( vconsole_t *vc, char ch )
+{
+    STAT_INC(chars);
+    if (vc->esc_state != ESC_NONE) {
+        parse_escape(vc, ch);
+    }
+    else if (ch == ASCII_ESC) {
+        vc->esc_state = ESC_START;
+    }
+    else if (ch == '\r') {
+        vc->cursor_col = 0;
+    }
+    else if (ch == '\n') {
+        vc->cursor_col = 0;
+        /* scroll if we called '\n' when we're on the last line */
+        if (vc->cursor_row == geom.height - 1) {
+            scroll(vc);
+        }
+        else {
+            vc->cursor_row++;
+        }
+    }
+    else if (ch == '\b') {
+        int *len = &vc->line_len[shadow_index(vc, vc->cursor_row)];
+        /* "normal" case where we can just write a space over prev character */
+        if (vc->cursor_col > 0) {
+            vc->cursor_col--;
+        }
+        else {
+            if (vc->cursor_row == 0) {
+                return;
+            }
+            vc->cursor_row--;
+            len = &vc->line_len[shadow_index(vc, vc->cursor_row)];
+            if (*len < geom.width) {
+                /* the line ended with a '\n', which is all we take back */
+                vc->cursor_col = *len;
+                return;
+            }
+            vc->cursor_col = geom.width - 1;
+        }
+        put_cell(vc, vc->cursor_row, vc->cursor_col, ASCII_SPACE, vc->color);
+        if (*len == vc->cursor_col + 1) {
+            *len = vc->cursor_col;
+        }
+    }
+    else {
+        put_cell(vc, vc->cursor_row, vc->cursor_col, ch, vc->color);
+        int *len = &vc->line_len[shadow_index(vc, vc->cursor_row)];
+        if (*len <= vc->cursor_col) {
+            *len = vc->cursor_col + 1;
+        }
+        /* increment the cursor position, next row/scrolling if necessary */
+        if (vc->cursor_col < geom.width - 1) {
+            vc->cursor_col++;
+        }
+        else {
+            vc->cursor_col = 0;
+            if (vc->cursor_row == geom.height - 1) {
+                scroll(vc);
+            }
+            else {
+                vc->cursor_row++;
+            }
+        }
+    }
+}
+
+/** @brief sink writing into the output console's shadow
+ *
+ *  @param s bytes to write
+ *  @param len number of bytes
+ *  @return Void.
+ */
+static void vga_sink_write(const char *s, int len)
+{
+    int i;
+    for (i = 0; i < len; i++) {
+        write_char(out, s[i]);
+    }
+}
+
+/** @brief sink appending to the in-memory log
+ *
+ *  @param s bytes to log
+ *  @param len number of bytes
+ *  @return Void.
+ */
+static void log_sink_write(const char *s, int len)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    int i;
+    for (i = 0; i < len; i++) {
+        log_ring[log_head++ & (CONSOLE_LOG_SIZE - 1)] = s[i];
+    }
+
+    set_eflags(eflags);
+}
+
+/* every sink there is, in the order they get written to */
+static const sink_t sinks[] = {
+    { "vga",    NULL,           vga_sink_write },
+    { "serial", serial_init,    serial_write },
+    { "log",    NULL,           log_sink_write },
+};
+#define NUM_SINKS ((int)(sizeof(sinks) / sizeof(sinks[0])))
+
+/** @brief sends bytes to every enabled sink
+ *
+ *  Each sink only copies the bytes into its own buffer, so a slow one (the
+ *  UART) never holds up the others.
+ *
+ *  @param s bytes to send
+ *  @param len number of bytes
+ *  @return Void.
+ */
+static void write_sinks(const char *s, int len)
+{
+    int i;
+    for (i = 0; i < NUM_SINKS; i++) {
+        if (enabled_sinks & (1 << i)) {
+            sinks[i].write(s, len);
+        }
+    }
+}
+
+int putbyte( char ch )
+{
+    write_sinks(&ch, 1);
+    flush_if_no_tick();
+    return ch;
+}
+
+void putbytes( const char *s, int len )
+{
+    if (len <= 0 || s == NULL) {
+        return;
+    }
+    STAT_TIME_START(start);
+
+    /**
+     *  The timer tick never writes the console itself, it posts to the ring
+     *  console_drain_posted() draws from. It can still flush a frame nobody
+     *  presented, though, which mustn't catch the string half written, with
+     *  an escape sequence only partly parsed and the cursor in the middle.
+     */
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    /* stop early if we reach null terminator */
+    int n = 0;
+    while (n < len && s[n] != '\0') {
+        n++;
+    }
+    write_sinks(s, n);
+
+    set_eflags(eflags);
+    flush_if_no_tick();
+    STAT_TIME_END(putbytes, start);
+}
+
+int set_term_color( int color )
+{
+    /* considering blink in color range */
+    if ((unsigned int)color > 0xFF) {
+        return -1;
+    }
+    out->color = color;
+    return 0;
+}
+
+void get_term_color( int *color )
+{
+    *color = out->color;
+}
+
+int set_cursor( int row, int col )
+{
+    if (!in_range(row, col)) {
+        return -1;
+    }
+    out->cursor_row = row;
+    out->cursor_col = col;
+    return 0;
+}
+
+void get_cursor( int *row, int *col )
+{
+    *row = out->cursor_row;
+    *col = out->cursor_col;
+}
+
+void hide_cursor(void)
+{
+    out->cursor_shown = false;
+}
+
+void show_cursor(void)
+{
+    out->cursor_shown = true;
+}
+
+void clear_console(void)
+{
+    /* only replace the character because we don't want to overwrite color */
+    console_clear(false);
+}
+
+void console_clear(bool reset_color)
+{
+    STAT_TIME_START(start);
+    /**
+     *  The rows in use are one contiguous block, so where the ring starts is
+     *  moot, and the unused cells at the end of each row are just as good to
+     *  clear in the same go.
+     */
+    int cells = (geom.height - 1) * SHADOW_STRIDE + geom.width;
+    if (reset_color) {
+        fill_cells(out->shadow[0], CONSOLE_CELL(ASCII_SPACE, out->color),
+                   cells);
+    }
+    else {
+        blank_cells(out->shadow[0], cells);
+    }
+    memset(out->line_len, 0, sizeof(out->line_len));
+    out->epoch++;
+    out->cursor_row = 0;
+    out->cursor_col = 0;
+    mark_all_dirty(out);
+    flush_if_no_tick();
+    STAT_INC(clears);
+    STAT_TIME_END(clear, start);
+}
+
+void draw_char( int row, int col, int ch, int color )
+{
+    STAT_INC(draw_chars);
+    if (!in_range(row, col)) {
+        return;
+    }
+    if ((unsigned int)color > 0xFF) {
+        return;
+    }
+    put_cell(out, row, col, ch, color);
+    flush_if_no_tick();
+}
+
+char get_char( int row, int col )
+{
+    if (!in_range(row, col)) {
+        return 0;
+    }
+    /* the shadow always holds what's on screen, no need to read VGA memory */
+    return CELL_CHAR(out->shadow[shadow_index(out, row)][col]);
+}
+
+uint16_t get_cell(int row, int col)
+{
+    if (!in_range(row, col)) {
+        return 0;
+    }
+    return out->shadow[shadow_index(out, row)][col];
+}
+
+void draw_cells(int row, int col, const uint16_t *cells, int n)
+{
+    int skip_rows, skip_cols;
+    int height = 1;
+    if (cells == NULL || !clip_rect(&row, &col, &height, &n,
+                                    &skip_rows, &skip_cols)) {
+        return;
+    }
+    memcpy(&out->shadow[shadow_index(out, row)][col], &cells[skip_cols],
+           n * sizeof(uint16_t));
+    mark_dirty(out, row);
+    flush_if_no_tick();
+}
+
+void fill_rect(int row, int col, int height, int width, uint16_t cell)
+{
+    int skip_rows, skip_cols;
+    if (!clip_rect(&row, &col, &height, &width, &skip_rows, &skip_cols)) {
+        return;
+    }
+    int end_row = row + height;
+    for (; row < end_row; row++) {
+        fill_cells(&out->shadow[shadow_index(out, row)][col], cell, width);
+        mark_dirty(out, row);
+    }
+    flush_if_no_tick();
+}
+
+void copy_rect(int dst_row, int dst_col, int src_row, int src_col,
+               int height, int width)
+{
+    int skip_rows, skip_cols;
+    /* clip the source, then the destination, keeping the two in step */
+    if (!clip_rect(&src_row, &src_col, &height, &width,
+                   &skip_rows, &skip_cols)) {
+        return;
+    }
+    dst_row += skip_rows;
+    dst_col += skip_cols;
+    if (!clip_rect(&dst_row, &dst_col, &height, &width,
+                   &skip_rows, &skip_cols)) {
+        return;
+    }
+    src_row += skip_rows;
+    src_col += skip_cols;
+
+    /* go bottom up when moving down so overlapping rows aren't clobbered */
+    int step = 1;
+    if (dst_row > src_row) {
+        src_row += height - 1;
+        dst_row += height - 1;
+        step = -1;
+    }
+    int i;
+    for (i = 0; i < height; i++) {
+        memmove(&out->shadow[shadow_index(out, dst_row)][dst_col],
+                &out->shadow[shadow_index(out, src_row)][src_col],
+                width * sizeof(uint16_t));
+        mark_dirty(out, dst_row);
+        src_row += step;
+        dst_row += step;
+    }
+    flush_if_no_tick();
+}
+
+void blit_sprite(int row, int col, const uint16_t *cells,
+                 int height, int width, uint16_t transparent)
+{
+    int skip_rows, skip_cols;
+    int stride = width;
+    if (cells == NULL || !clip_rect(&row, &col, &height, &width,
+                                    &skip_rows, &skip_cols)) {
+        return;
+    }
+    const uint16_t *src = &cells[skip_rows * stride + skip_cols];
+    int end_row = row + height;
+    for (; row < end_row; row++) {
+        uint16_t *dst = &out->shadow[shadow_index(out, row)][col];
+        int i;
+        for (i = 0; i < width; i++) {
+            if (src[i] != transparent) {
+                dst[i] = src[i];
+            }
+        }
+        mark_dirty(out, row);
+        src += stride;
+    }
+    flush_if_no_tick();
+}
+
+void console_flush(void)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    if (vga_released) {
+        /* the dirty rows just pile up until the VGA is given back */
+        set_eflags(eflags);
+        return;
+    }
+
+    if (claim_region()) {
+        set_start_address();
+    }
+    if (shown->dirty) {
+        shown->dirty = false;
+        apply_pending_scroll();
+        /**
+         *  Dirty flags belong to shadow rows, which aren't where they usually
+         *  are while looking at history, so then every row gets compared.
+         */
+        bool check_all = shown->viewing_history || shown->view_moved;
+        int row;
+        for (row = 0; row < geom.height; row++) {
+            int index = shadow_index(shown, row);
+            if (shown->row_dirty[index] || check_all) {
+                shown->row_dirty[index] = false;
+                flush_row(row);
+            }
+        }
+        shown->view_moved = false;
+    }
+    sync_cursor();
+
+    set_eflags(eflags);
+}
+
+void console_sync_cursor(void)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    if (shown->dirty) {
+        /* a pending scroll would move the start address out from under it */
+        console_flush();
+    }
+    else {
+        sync_cursor();
+    }
+    set_eflags(eflags);
+}
+
+void console_snapshot_save(console_snapshot_t *snap)
+{
+    if (snap == NULL) {
+        return;
+    }
+    snap->geometry = geom;
+    int row;
+    for (row = 0; row < geom.height; row++) {
+        int index = shadow_index(out, row);
+        memcpy(snap->cells[row], out->shadow[index],
+               geom.width * sizeof(uint16_t));
+        snap->line_len[row] = out->line_len[index];
+    }
+    snap->cursor_row = out->cursor_row;
+    snap->cursor_col = out->cursor_col;
+    snap->cursor_shown = out->cursor_shown;
+    snap->color = out->color;
+}
+
+int console_snapshot_restore(const console_snapshot_t *snap)
+{
+    if (snap == NULL) {
+        return -1;
+    }
+    if (snap->geometry.width != geom.width ||
+        snap->geometry.height != geom.height) {
+        return -1;
+    }
+    int row;
+    for (row = 0; row < geom.height; row++) {
+        int index = shadow_index(out, row);
+        const uint16_t *src = snap->cells[row];
+        uint16_t *dst = out->shadow[index];
+        out->line_len[index] = snap->line_len[row];
+        /* trim the cells that already match, just like flush_row() does */
+        int lo = 0;
+        int hi = geom.width;
+        while (lo < hi && src[lo] == dst[lo]) {
+            lo++;
+        }
+        while (hi > lo && src[hi - 1] == dst[hi - 1]) {
+            hi--;
+        }
+        if (lo < hi) {
+            memcpy(&dst[lo], &src[lo], (hi - lo) * sizeof(uint16_t));
+            mark_dirty(out, row);
+        }
+    }
+    out->cursor_row = snap->cursor_row;
+    out->cursor_col = snap->cursor_col;
+    out->cursor_shown = snap->cursor_shown;
+    out->color = snap->color;
+    flush_if_no_tick();
+    return 0;
+}
+
+int console_scrollback_init(int lines)
+{
+    if (lines <= 0) {
+        return -1;
+    }
+    int ret = 0;
+    int i;
+    for (i = 0; i < CONSOLE_COUNT; i++) {
+        vconsole_t *vc = &consoles[i];
+        if (vc->history != NULL) {
+            ret = -1;
+            continue;
+        }
+        vc->history = malloc(lines * CONSOLE_MAX_WIDTH * sizeof(uint16_t));
+        if (vc->history == NULL) {
+            ret = -1;
+            continue;
+        }
+        vc->history_size = lines;
+        vc->history_count = 0;
+        vc->history_next = 0;
+    }
+    return ret;
+}
+
+void console_scroll_view(int lines)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    unsigned int line = top_line(shown) + lines;
+    unsigned int oldest = shown->lines_scrolled - shown->history_count;
+    if ((int)(line - oldest) < 0) {
+        line = oldest;
+    }
+    /* scrolling down to or past the live screen goes back to following it */
+    shown->viewing_history = (int)(line - shown->lines_scrolled) < 0;
+    shown->view_line = line;
+    shown->view_moved = true;
+    shown->dirty = true;
+
+    set_eflags(eflags);
+    flush_if_no_tick();
+}
+
+void console_view_live(void)
+{
+    if (shown->viewing_history) {
+        console_scroll_view(shown->lines_scrolled - shown->view_line);
+    }
+}
+
+void console_set_hw_scroll(bool enable)
+{
+    hw_scroll = enable;
+    /* let the next flush move the screen back to the start of its region */
+    shown->dirty = true;
+    flush_if_no_tick();
+}
+
+int console_switch(int index)
+{
+    if (index < 0 || index >= CONSOLE_COUNT) {
+        return -1;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    shown = &consoles[index];
+    /**
+     *  If the console still owns its region, pointing the CRTC there and
+     *  copying out whatever changed while it was hidden is all it takes.
+     */
+    claim_region();
+    set_start_address();
+    shown->dirty = true;
+
+    set_eflags(eflags);
+    console_flush();
+    return 0;
+}
+
+int console_get_shown(void)
+{
+    return shown - consoles;
+}
+
+int console_set_output(int index)
+{
+    if (index < 0 || index >= CONSOLE_COUNT) {
+        return -1;
+    }
+    out = &consoles[index];
+    return 0;
+}
+
+int console_get_output(void)
+{
+    return out - consoles;
+}
+
+int console_post_text(int console, int row, int col, int color,
+                      const char *text, int len)
+{
+    if (console < 0 || console >= CONSOLE_COUNT || text == NULL || len < 0) {
+        return -1;
+    }
+    if (len > CONSOLE_POST_MAX) {
+        len = CONSOLE_POST_MAX;
+    }
+
+    unsigned int head = post_head;
+    if (head - post_tail == POST_SLOTS) {
+        return -1;
+    }
+    /* don't fill in the slot until we've seen the consumer is done with it */
+    COMPILER_BARRIER();
+
+    posted_text_t *post = &post_ring[head & (POST_SLOTS - 1)];
+    post->console = console;
+    post->epoch = consoles[console].epoch;
+    post->row = row;
+    post->col = col;
+    post->color = color;
+    post->len = len;
+    memcpy(post->text, text, len);
+    /* the slot has to be filled in before the consumer can see it */
+    COMPILER_BARRIER();
+    post_head = head + 1;
+    return 0;
+}
+
+int console_drain_posted(void)
+{
+    unsigned int first = post_tail;
+    unsigned int tail = first;
+    unsigned int head = post_head;
+    if (tail == head) {
+        return 0;
+    }
+    /* only read the slots after seeing post_head say they're filled in */
+    COMPILER_BARRIER();
+
+    for (; tail != head; tail++) {
+        posted_text_t *post = &post_ring[tail & (POST_SLOTS - 1)];
+        vconsole_t *vc = &consoles[post->console];
+        int height = 1;
+        int row = post->row;
+        int col = post->col;
+        int n = post->len;
+        int skip_rows, skip_cols;
+        if (post->epoch != vc->epoch ||
+            !clip_rect(&row, &col, &height, &n, &skip_rows, &skip_cols)) {
+            continue;
+        }
+        uint16_t *dst = &vc->shadow[shadow_index(vc, row)][col];
+        int i;
+        for (i = 0; i < n; i++) {
+            dst[i] = CONSOLE_CELL(post->text[skip_cols + i], post->color);
+        }
+        mark_dirty(vc, row);
+    }
+
+    /* done reading the slots before handing them back to the producers */
+    COMPILER_BARRIER();
+    post_tail = tail;
+    flush_if_no_tick();
+    return (int)(head - first);
+}
+
+int console_set_mode(const char *name)
+{
+    const vga_text_mode_t *mode = vga_find_text_mode(name);
+    if (mode == NULL) {
+        return -1;
+    }
+    if (mode->width > CONSOLE_MAX_WIDTH || mode->height > CONSOLE_MAX_HEIGHT) {
+        return -1;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    vga_set_text_mode(mode);
+    text_mode = mode;
+    geom.width = mode->width;
+    geom.height = mode->height;
+
+    /**
+     *  Every row of every console moves, as do the regions of VGA memory, so
+     *  rather than reflowing anything all consoles start over blank.
+     */
+    int i;
+    for (i = 0; i < CONSOLE_COUNT; i++) {
+        vconsole_t *vc = &consoles[i];
+        fill_cells(vc->shadow[0], CONSOLE_CELL(ASCII_SPACE, vc->color),
+                   CONSOLE_MAX_HEIGHT * SHADOW_STRIDE);
+        memset(vc->line_len, 0, sizeof(vc->line_len));
+        vc->epoch++;
+        vc->shadow_top = 0;
+        vc->lines_scrolled = 0;
+        vc->history_count = 0;
+        vc->history_next = 0;
+        vc->viewing_history = false;
+        vc->cursor_row = 0;
+        vc->cursor_col = 0;
+        mark_all_dirty(vc);
+    }
+    for (i = 0; i < CONSOLE_COUNT; i++) {
+        regions[i].owner = -1;
+    }
+    claim_region();
+    set_start_address();
+
+    set_eflags(eflags);
+    console_flush();
+    return 0;
+}
+
+void console_release_vga(void)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    vga_released = true;
+    set_eflags(eflags);
+}
+
+void console_reclaim_vga(void)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    if (text_mode == NULL) {
+        text_mode = vga_find_text_mode(CONSOLE_DEFAULT_MODE);
+    }
+    vga_set_text_mode(text_mode);
+    vga_released = false;
+
+    /* nothing in VGA memory or the CRTC can be trusted, so start over */
+    memset(vga_row_valid, 0, sizeof(vga_row_valid));
+    int i;
+    for (i = 0; i < CONSOLE_COUNT; i++) {
+        regions[i].owner = -1;
+    }
+    hw_cursor_msb = -1;
+    hw_cursor_lsb = -1;
+    claim_region();
+    set_start_address();
+
+    set_eflags(eflags);
+    console_flush();
+}
+
+int console_set_sinks(const char *list)
+{
+    unsigned int enable = 0;
+    const char *name = list;
+    while (1) {
+        int len = 0;
+        while (name[len] != ',' && name[len] != '\0') {
+            len++;
+        }
+        int i;
+        for (i = 0; i < NUM_SINKS; i++) {
+            if (strncmp(sinks[i].name, name, len) == 0 &&
+                sinks[i].name[len] == '\0') {
+                break;
+            }
+        }
+        if (i == NUM_SINKS) {
+            return -1;
+        }
+        enable |= 1 << i;
+        if (name[len] == '\0') {
+            break;
+        }
+        name += len + 1;
+    }
+
+    int i;
+    for (i = 0; i < NUM_SINKS; i++) {
+        if ((enable & (1 << i)) && sinks[i].init != NULL &&
+            sinks[i].init() < 0) {
+            return -1;
+        }
+    }
+    enabled_sinks = enable;
+    return 0;
+}
+
+int console_log_read(char *buf, int len)
+{
+    if (buf == NULL || len < 0) {
+        return -1;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    unsigned int kept = log_head < CONSOLE_LOG_SIZE ? log_head :
+                                                      CONSOLE_LOG_SIZE;
+    if ((unsigned int)len > kept) {
+        len = kept;
+    }
+    unsigned int from = log_head - len;
+    int i;
+    for (i = 0; i < len; i++) {
+        buf[i] = log_ring[(from + i) & (CONSOLE_LOG_SIZE - 1)];
+    }
+
+    set_eflags(eflags);
+    return len;
+}
+
+const console_geometry_t *console_get_geometry(void)
+{
+    return &geom;
+}
+
+#ifdef CONSOLE_BENCHMARK
+/* number of times each way of clearing is timed */
+#define BENCHMARK_ROUNDS 1000
+
+/* cells in a screen of the mode we boot in */
+#define BENCHMARK_CELLS (CONSOLE_WIDTH * CONSOLE_HEIGHT)
+
+/* scratch screen the benchmark clears, so what's on the real one survives */
+static uint16_t bench_cells[BENCHMARK_CELLS];
+
+/** @brief times one way of clearing the scratch screen
+ *
+ *  @param how 0 for the old byte loop, 1 for the old cell loop, 2 for
+ *         blank_cells() and 3 for fill_cells()
+ *  @return average number of cycles one clear took
+ */
+static unsigned int bench_clear(int how)
+{
+    uint64_t start = rdtsc();
+    int round;
+    for (round = 0; round < BENCHMARK_ROUNDS; round++) {
+        if (how == 0) {
+            /* what clear_console() used to do straight to VGA memory */
+            char *curr = (char*)bench_cells;
+            char *end = curr + sizeof(bench_cells);
+            while (curr < end) {
+                curr[0] = ASCII_SPACE;
+                curr += 2;
+            }
+        }
+        else if (how == 1) {
+            /* what clear_console() used to do to the shadow */
+            uint16_t *curr = bench_cells;
+            uint16_t *end = curr + BENCHMARK_CELLS;
+            while (curr < end) {
+                *curr = CONSOLE_CELL(ASCII_SPACE, CELL_COLOR(*curr));
+                curr++;
+            }
+        }
+        else if (how == 2) {
+            blank_cells(bench_cells, BENCHMARK_CELLS);
+        }
+        else {
+            fill_cells(bench_cells, BLANK_CELL, BENCHMARK_CELLS);
+        }
+    }
+    return (unsigned int)((rdtsc() - start) / BENCHMARK_ROUNDS);
+}
+
+void console_benchmark_clear(void)
+{
+    lprintf("console: cycles per clear of %d cells", BENCHMARK_CELLS);
+    lprintf("  byte loop:                 %u", bench_clear(0));
+    lprintf("  cell loop:                 %u", bench_clear(1));
+    lprintf("  blank_cells() keep colors: %u", bench_clear(2));
+    lprintf("  fill_cells() reset colors: %u", bench_clear(3));
+}
+#endif /* CONSOLE_BENCHMARK */
+
+#ifdef CONSOLE_STATS
+/** @brief logs one timer
+ *
+ *  lprintf() can't print 64 bit numbers, so the total is in kilocycles.
+ *
+ *  @param name what was timed
+ *  @param timer timer to log
+ *  @return Void.
+ */
+static void stat_timer_dump(const char *name, stat_timer_t *timer)
+{
+    unsigned int avg = 0;
+    if (timer->calls > 0) {
+        avg = (unsigned int)(timer->total / timer->calls);
+    }
+    lprintf("  %-14s %8u calls %10u kcycles %8u avg %8u max", name,
+            timer->calls, (unsigned int)(timer->total / 1000), avg,
+            (unsigned int)timer->max);
+}
+
+void console_stats_dump(void)
 {
-    char *read_addr = (char*)(CONSOLE_MEM_BASE +
-                              2 * (row * CONSOLE_WIDTH + col));
-    return *read_addr;
+    lprintf("console stats:");
+    lprintf("  chars written  %u", stats.chars);
+    lprintf("  scrolls        %u", stats.scrolls);
+    lprintf("  CRTC writes    %u", stats.crtc_writes);
+    lprintf("  clears         %u", stats.clears);
+    lprintf("  draw_char      %u", stats.draw_chars);
+    lprintf("  bytes flushed  %u", stats.bytes_flushed);
+    stat_timer_dump("putbytes", &stats.putbytes);
+    stat_timer_dump("clear_console", &stats.clear);
+    stat_timer_dump("scroll", &stats.scroll);
 }
+#endif /* CONSOLE_STATS */
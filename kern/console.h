@@ -0,0 +1,402 @@
+/** @file console.h
+ *  @brief console driver extensions
+ *
+ *  Interface for the parts of the console driver that go beyond the handout
+ *  interface in p1kern.h. All console writes land in an in-RAM shadow of the
+ *  VGA text buffer and are only copied out to VGA memory when the console is
+ *  flushed. That happens once per frame in compositor_present(), or from the
+ *  timer tick for frames nobody presents, after each key readline() handles,
+ *  on every write made with interrupts disabled, and whenever anybody that
+ *  wants their output on the screen sooner calls console_flush().
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef __CONSOLE_H_
+#define __CONSOLE_H_
+
+#include <stdint.h>         /* uint16_t */
+#include <stdbool.h>        /* bool */
+#include <video_defines.h>  /* FGND_WHITE, BGND_BLACK, ... */
+
+/**
+ *  largest screen of any text mode console_set_mode() can switch to; the
+ *  screen starts out CONSOLE_WIDTH by CONSOLE_HEIGHT
+ */
+#define CONSOLE_MAX_WIDTH   90
+#define CONSOLE_MAX_HEIGHT  60
+/* number of cells needed to hold a copy of the whole screen in any mode */
+#define CONSOLE_MAX_CELLS   (CONSOLE_MAX_HEIGHT * CONSOLE_MAX_WIDTH)
+/* text mode the BIOS leaves the VGA in */
+#define CONSOLE_DEFAULT_MODE "80x25"
+
+/* a VGA text cell is the character in the low byte and color in the high */
+#define CONSOLE_CELL(ch, color) \
+    ((uint16_t)((((color) & 0xFF) << 8) | ((ch) & 0xFF)))
+
+/**
+ *  ANSI numbers the 8 base colors with red and blue swapped compared to VGA
+ *  (and so cyan and brown/yellow), so this converts one to the other either way
+ */
+#define CONSOLE_ANSI_COLOR(c) \
+    ((((c) & 0x1) << 2) | ((c) & 0x2) | (((c) >> 2) & 0x1))
+/* printf() format and arguments for an SGR sequence selecting a VGA color */
+#define CONSOLE_SGR_FMT "\033[%d;%d;%d;%dm"
+#define CONSOLE_SGR_ARGS(color) \
+    (((color) & 0x08) ? 1 : 22), \
+    30 + CONSOLE_ANSI_COLOR((color) & 0x7), \
+    40 + CONSOLE_ANSI_COLOR(((color) >> 4) & 0x7), \
+    (((color) & 0x80) ? 5 : 25)
+
+/* define to build console_benchmark_clear() and run it at boot */
+/* #define CONSOLE_BENCHMARK */
+/* define to build console_stats_dump() and count what the driver does */
+/* #define CONSOLE_STATS */
+
+/* number of virtual consoles, switched between with Alt+F1, Alt+F2, ... */
+#define CONSOLE_COUNT 4
+
+/* lines of scrollback history kept per console. Each line is stored
+ * CONSOLE_MAX_WIDTH cells wide, so this is 180KB per console, 720KB for all
+ * of them */
+#define CONSOLE_SCROLLBACK_LINES 1024
+/* lines moved by one Shift+PgUp/Shift+PgDn */
+#define CONSOLE_SCROLLBACK_PAGE (console_get_geometry()->height / 2)
+
+/* most characters one console_post_text() call can carry */
+#define CONSOLE_POST_MAX 32
+
+/* bytes of output the log sink keeps, a power of two */
+#define CONSOLE_LOG_SIZE 16384
+
+/* size of the screen in the current text mode */
+typedef struct {
+    int width;      /* columns, at most CONSOLE_MAX_WIDTH */
+    int height;     /* rows, at most CONSOLE_MAX_HEIGHT */
+} console_geometry_t;
+
+/* a copy of a console's screen, see console_snapshot_save() */
+typedef struct {
+    console_geometry_t geometry;    /* size of the screen it was saved from */
+    uint16_t cells[CONSOLE_MAX_HEIGHT][CONSOLE_MAX_WIDTH];
+    int line_len[CONSOLE_MAX_HEIGHT];   /* length of the text on each row */
+    int cursor_row;
+    int cursor_col;
+    bool cursor_shown;
+    int color;
+} console_snapshot_t;
+
+/** @brief copies every changed row span from the shadow out to VGA memory
+ *
+ *  Only rows that were written to since the last flush are looked at, and of
+ *  those only the span of cells that actually differs from what VGA memory is
+ *  known to hold gets copied. Runs with interrupts disabled, so it can't be
+ *  interleaved with another flush or a console switch.
+ *
+ *  @return Void.
+ */
+void console_flush(void);
+/** @brief writes one CRTC register
+ *
+ *  Every CRTC write goes through here, the console's own and the ones vga.c
+ *  makes to switch modes, so that CONSOLE_STATS counts all of them.
+ *
+ *  @param index CRTC register to write
+ *  @param value value to write to it
+ *  @return Void.
+ */
+void console_crtc_write(uint8_t index, uint8_t value);
+/** @brief programs the hardware cursor to where the software cursor is now
+ *
+ *  set_cursor(), show_cursor() and hide_cursor() only update the software
+ *  cursor, which gets onto the screen at the next flush. Call this to have it
+ *  show up right away instead. Does no port I/O if the cursor didn't move.
+ *
+ *  @return Void.
+ */
+void console_sync_cursor(void);
+/** @brief saves everything needed to put the screen back the way it is now
+ *
+ *  Copies the cells, line lengths, cursor position, cursor visibility and
+ *  color of the console output goes to. Reads from the shadow, so this never
+ *  touches VGA memory.
+ *
+ *  @param snap where to save the screen to
+ *  @return Void.
+ */
+void console_snapshot_save(console_snapshot_t *snap);
+/** @brief puts the screen back the way it was when a snapshot was saved
+ *
+ *  Only the cells that differ from what's on screen now are written, so
+ *  undoing a small overlay drawn over the screen only costs as much as the
+ *  overlay did. Rows that didn't change aren't even looked at by the flush.
+ *
+ *  @param snap snapshot saved by console_snapshot_save()
+ *  @return 0 on success, negative if the snapshot is NULL or was saved in a
+ *          text mode of a different size
+ */
+int console_snapshot_restore(const console_snapshot_t *snap);
+/** @brief starts keeping lines that scroll off the top of the screen
+ *
+ *  Allocates a ring of the given number of lines with malloc() for every
+ *  virtual console. Once a ring is full, the oldest lines get overwritten.
+ *  Until this is called, lines that scroll off are lost.
+ *
+ *  @param lines number of lines of history to keep per console
+ *  @return 0 on success, negative if lines isn't positive, history was
+ *          already set up, or an allocation failed
+ */
+int console_scrollback_init(int lines);
+/** @brief moves the view up into history or back down towards live output
+ *
+ *  Negative counts scroll back into history, positive ones scroll forward.
+ *  The view stops at the oldest line kept, and going forward to the live
+ *  screen makes it follow new output again. While looking at history, new
+ *  output doesn't move the view and the cursor is hidden. Works on the
+ *  console that's on screen, not the one output goes to.
+ *
+ *  @param lines number of lines to move the view by
+ *  @return Void.
+ */
+void console_scroll_view(int lines);
+/** @brief moves the view back to the live screen if it was in history
+ *
+ *  @return Void.
+ */
+void console_view_live(void);
+/** @brief turns scrolling through the CRTC start address on or off
+ *
+ *  Hardware scrolling is on by default. With it on, scrolling only moves the
+ *  address VGA memory is displayed from, and the screen is copied back to the
+ *  start of VGA memory once it runs off the end. With it off, every scroll
+ *  rewrites the changed rows in place at the start of VGA memory.
+ *
+ *  @param enable whether to scroll with the CRTC start address
+ *  @return Void.
+ */
+void console_set_hw_scroll(bool enable);
+/** @brief clears the screen and moves the cursor to the top left
+ *
+ *  clear_console() is console_clear(false). Resetting the colors is the
+ *  faster of the two, since no cell has to be read back first.
+ *
+ *  @param reset_color whether to set every cell to console_color as well,
+ *         instead of keeping the color each cell already had
+ *  @return Void.
+ */
+void console_clear(bool reset_color);
+/** @brief reads back a whole cell of the output console's screen
+ *
+ *  Like get_char(), reads the console's copy of the screen in RAM rather than
+ *  VGA memory, so it costs no more than an array lookup.
+ *
+ *  @param row row of the cell
+ *  @param col column of the cell
+ *  @return the cell as built by CONSOLE_CELL(), or 0 if row/col are out of
+ *          range
+ */
+uint16_t get_cell(int row, int col);
+/** @brief draws a run of cells along a row
+ *
+ *  Unlike draw_char(), the cells already hold their colors and aren't
+ *  checked, and anything running off the screen is clipped instead of the
+ *  whole call being ignored. The run doesn't wrap onto the next row.
+ *
+ *  @param row row to draw at
+ *  @param col column of the first cell, may be off the left edge
+ *  @param cells cells to draw, built with CONSOLE_CELL()
+ *  @param n number of cells to draw
+ *  @return Void.
+ */
+void draw_cells(int row, int col, const uint16_t *cells, int n);
+/** @brief fills a rectangle of the screen with the same cell
+ *
+ *  Clipped to the screen.
+ *
+ *  @param row top row of the rectangle
+ *  @param col left column of the rectangle
+ *  @param height number of rows to fill
+ *  @param width number of columns to fill
+ *  @param cell cell to fill with, built with CONSOLE_CELL()
+ *  @return Void.
+ */
+void fill_rect(int row, int col, int height, int width, uint16_t cell);
+/** @brief copies a rectangle of the screen somewhere else on the screen
+ *
+ *  Both rectangles are clipped to the screen and may overlap.
+ *
+ *  @param dst_row top row to copy to
+ *  @param dst_col left column to copy to
+ *  @param src_row top row to copy from
+ *  @param src_col left column to copy from
+ *  @param height number of rows to copy
+ *  @param width number of columns to copy
+ *  @return Void.
+ */
+void copy_rect(int dst_row, int dst_col, int src_row, int src_col,
+               int height, int width);
+/** @brief draws a rectangular sprite, leaving some of its cells see-through
+ *
+ *  Cells of the sprite equal to transparent aren't drawn, so whatever was on
+ *  screen there stays. Clipped to the screen.
+ *
+ *  @param row top row to draw the sprite at
+ *  @param col left column to draw the sprite at
+ *  @param cells height rows of width cells each, top row first
+ *  @param height number of rows in the sprite
+ *  @param width number of columns in the sprite
+ *  @param transparent cell value that isn't drawn
+ *  @return Void.
+ */
+void blit_sprite(int row, int col, const uint16_t *cells,
+                 int height, int width, uint16_t transparent);
+/** @brief puts one of the virtual consoles on screen
+ *
+ *  Each console has its own screen, cursor, color and scrollback. Every
+ *  console has a region of VGA memory it stays in while hidden, so switching
+ *  back to it just moves the CRTC start address and copies out the rows that
+ *  changed in the meantime. Only if it has to share its region with another
+ *  console does the whole screen get copied.
+ *
+ *  @param index console to show, from 0 to CONSOLE_COUNT - 1
+ *  @return 0 on success, negative if index is out of range
+ */
+int console_switch(int index);
+/** @brief tells which virtual console is on screen
+ *
+ *  @return index of the console on screen
+ */
+int console_get_shown(void);
+/** @brief picks the virtual console that output goes to
+ *
+ *  putbyte(), draw_char(), set_cursor() and every other function writing to
+ *  or asking about the console work on this console, whether it's shown or
+ *  not. Output to a console that isn't shown only goes to RAM until it's
+ *  switched to.
+ *
+ *  @param index console to write to, from 0 to CONSOLE_COUNT - 1
+ *  @return 0 on success, negative if index is out of range
+ */
+int console_set_output(int index);
+/** @brief tells which virtual console output goes to
+ *
+ *  @return index of the console written to
+ */
+int console_get_output(void);
+/** @brief queues text to be drawn later, for use from interrupt handlers
+ *
+ *  Doesn't touch any of the console's state, so it can't race with the main
+ *  loop drawing; the text is only copied into a ring without locking or
+ *  disabling interrupts, and drawn the next time console_drain_posted()
+ *  runs. The text is drawn as cells, so the cursor and
+ *  color of the console stay as they are. If the console gets cleared before
+ *  the text is drawn, the text is dropped, since it was meant for the screen
+ *  that got cleared.
+ *
+ *  @param console index of the console to draw on
+ *  @param row row to draw at
+ *  @param col column of the first character, clipped like draw_cells()
+ *  @param color color to draw with
+ *  @param text characters to draw, escape sequences aren't interpreted
+ *  @param len number of characters, at most CONSOLE_POST_MAX are kept
+ *  @pre only ever called from one place at a time, like the timer handler,
+ *       which the PIC won't run again until it's done
+ *  @return 0 on success, negative if the arguments are bad or the ring is full
+ */
+int console_post_text(int console, int row, int col, int color,
+                      const char *text, int len);
+/** @brief draws everything posted with console_post_text() so far
+ *
+ *  The main loop calls this; the whole batch is drawn into the shadows before
+ *  anything is flushed.
+ *
+ *  @pre only ever called from one place at a time, never from an interrupt
+ *       handler
+ *  @return number of posts taken off the ring, including stale ones that
+ *          weren't drawn
+ */
+int console_drain_posted(void);
+/** @brief switches the VGA to another text mode
+ *
+ *  Programs the VGA registers for the mode and blanks every console, since
+ *  none of their rows would line up with the new screen anymore. Scrollback
+ *  history is dropped as well. Meant to be called once at boot, before
+ *  anything has been drawn.
+ *
+ *  @param name mode to switch to, "80x25", "80x50" or "90x60"
+ *  @return 0 on success, negative if there is no mode with that name
+ */
+int console_set_mode(const char *name);
+/** @brief stops the console from touching the VGA at all
+ *
+ *  For handing the VGA to a graphics mode. Everything still gets drawn into
+ *  the consoles' shadows, it just isn't flushed until console_reclaim_vga().
+ *
+ *  @return Void.
+ */
+void console_release_vga(void);
+/** @brief puts the VGA back into the console's text mode and redraws it
+ *
+ *  VGA memory is assumed to have been drawn all over, so every row of the
+ *  shown console is written out again.
+ *
+ *  @return Void.
+ */
+void console_reclaim_vga(void);
+/** @brief picks where putbyte()/putbytes() output goes
+ *
+ *  The sinks are "vga", the screen, "serial", COM1, and "log", a ring in
+ *  memory holding the last CONSOLE_LOG_SIZE bytes. Every enabled sink gets
+ *  the same bytes, escape sequences and all; only "vga" interprets them.
+ *  Output starts out going to "vga" alone. Drawing functions like draw_char()
+ *  only ever affect the screen. Meant to be called once at boot.
+ *
+ *  @pre if "serial" is named, interrupts are disabled until handler_install()
+ *       has installed the serial handler
+ *  @param list comma separated names of the sinks to enable, e.g.
+ *         "vga,serial"; any sink not named is disabled
+ *  @return 0 on success, negative if a name is unknown or a sink failed to
+ *          set up, in which case the sinks stay as they were
+ */
+int console_set_sinks(const char *list);
+/** @brief copies the most recent output out of the log sink
+ *
+ *  @param buf where to copy the bytes to, oldest first; not NUL terminated
+ *  @param len size of buf
+ *  @return number of bytes copied, at most len, or negative if buf is NULL or
+ *          len is negative
+ */
+int console_log_read(char *buf, int len);
+/** @brief tells how big the screen is in the current text mode
+ *
+ *  @return size of the screen, which stays valid and changes along with the
+ *          mode
+ */
+const console_geometry_t *console_get_geometry(void);
+
+#ifdef CONSOLE_BENCHMARK
+/** @brief times the ways of clearing the screen and logs them with lprintf()
+ *
+ *  Compares the old byte at a time and cell at a time clearing loops against
+ *  blank_cells() and fill_cells() on a scratch buffer, reading the cycle
+ *  counter around a thousand rounds of each.
+ *
+ *  @return Void.
+ */
+void console_benchmark_clear(void);
+#endif
+
+#ifdef CONSOLE_STATS
+/** @brief logs the console driver's counters and timings with lprintf()
+ *
+ *  Counts cover everything since boot: characters written, lines scrolled,
+ *  CRTC port writes, clears, draw_char() calls and bytes copied out to VGA
+ *  memory. putbytes(), clearing and scrolling are timed with the cycle
+ *  counter, and each gets its call count, average and worst case logged.
+ *
+ *  @return Void.
+ */
+void console_stats_dump(void);
+#endif
+
+#endif /* __CONSOLE_H_ */
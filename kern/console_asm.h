@@ -0,0 +1,27 @@
+/** @file console_asm.h
+ *  @brief function prototypes for asm console helper functions
+ *
+ *  This file contains the function prototype declarations for the parts of the
+ *  console driver that are written in assembly, because gcc won't generate
+ *  anything as tight for them at the optimization level we build with.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef __CONSOLE_ASM_H_
+#define __CONSOLE_ASM_H_
+
+#include <stdint.h>     /* uint32_t */
+
+/** @brief Fills memory with a repeated 32-bit pattern using rep stosl
+ *
+ *  Used to fill two cells at a time with the same pair of cells.
+ *
+ *  @param dst first dword to fill, should be 4 byte aligned
+ *  @param pattern value to store into every dword
+ *  @param count number of dwords to fill, has to be positive
+ *  @return Void.
+ */
+void fill_dwords(uint32_t *dst, uint32_t pattern, int count);
+
+#endif /* __CONSOLE_ASM_H_ */
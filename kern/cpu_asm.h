@@ -0,0 +1,26 @@
+/** @file cpu_asm.h
+ *  @brief function prototypes for asm processor helper functions
+ *
+ *  This file contains the function prototype declarations for the processor
+ *  instructions C can't get at through the 410kern asm.h helpers.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef __CPU_ASM_H_
+#define __CPU_ASM_H_
+
+/** @brief Enables interrupts and halts until the next one arrives
+ *
+ *  sti doesn't let interrupts in until after the instruction following it,
+ *  so nothing can be taken between the two and an interrupt that became
+ *  pending while they were disabled wakes the hlt instead of being missed.
+ *  Checking for work with interrupts disabled and then calling this is how
+ *  to go to sleep without racing the interrupt that brings the work.
+ *
+ *  @pre interrupts are disabled
+ *  @return Void, with interrupts enabled
+ */
+void sti_hlt(void);
+
+#endif /* __CPU_ASM_H_ */
@@ -33,12 +33,27 @@ void tick(unsigned int numTicks);
 #include <x86/asm.h>                /* enable_interrupts() */
 
 #include <string.h>
+#include <stdlib.h>                 /* atoi() */
 
 #include <sokoban.h>
 #include <sokoban_game.h>
 
 #include <timer.h>
 #include <kb_buffer.h>
+#include <console.h>
+#include <compositor.h>
+
+/**
+ *  kernel command line variable picking the text mode, e.g. "console=80x50";
+ *  the boot code hands anything with an '=' in it to us in envp
+ */
+#define CONSOLE_MODE_ARG "console="
+/* and the one picking where console output goes, e.g. "sinks=vga,serial" */
+#define CONSOLE_SINKS_ARG "sinks="
+/* and the one that has the board drawn in mode 13h tiles */
+#define BOARD_TILES_ARG "board=tiles"
+/* and the one setting how many frames a second are drawn, e.g. "fps=30" */
+#define FRAME_RATE_ARG "fps="
 
 /* timer declared in timer.h */
 extern timer_t timer;
@@ -54,11 +69,40 @@ extern kb_buf_t kb_buffer;
  */
 int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
 {
+    /**
+     *  An unknown mode just leaves the console at 80x25, a bad sink list
+     *  leaves output going to the screen alone, and a bad frame rate leaves
+     *  it at COMPOSITOR_DEFAULT_RATE.
+     */
+    int i;
+    for (i = 0; envp[i] != NULL; i++) {
+        if (strncmp(envp[i], CONSOLE_MODE_ARG,
+                    strlen(CONSOLE_MODE_ARG)) == 0) {
+            console_set_mode(envp[i] + strlen(CONSOLE_MODE_ARG));
+        }
+        else if (strncmp(envp[i], CONSOLE_SINKS_ARG,
+                         strlen(CONSOLE_SINKS_ARG)) == 0) {
+            console_set_sinks(envp[i] + strlen(CONSOLE_SINKS_ARG));
+        }
+        else if (strcmp(envp[i], BOARD_TILES_ARG) == 0) {
+            sokoban_use_tiles();
+        }
+        else if (strncmp(envp[i], FRAME_RATE_ARG,
+                         strlen(FRAME_RATE_ARG)) == 0) {
+            compositor_set_rate(atoi(envp[i] + strlen(FRAME_RATE_ARG)));
+        }
+    }
+
     /*
      * Initialize device-driver library.
      */
     timer_initialize(&timer, NULL);
     kb_buf_initialize(&kb_buffer);
+    /* not fatal if this fails, we just don't get any scrollback */
+    console_scrollback_init(CONSOLE_SCROLLBACK_LINES);
+#ifdef CONSOLE_BENCHMARK
+    console_benchmark_clear();
+#endif
 
     handler_install(tick);
 
@@ -0,0 +1,244 @@
+/** @file gfx.c
+ *  @brief mode 13h tile renderer implementation
+ *
+ *  The screen is GFX_ROWS by GFX_COLS tiles, and tile_key remembers what each
+ *  one shows: a sprite, or the text cell it was drawn from. Drawing a tile
+ *  that already shows the same thing returns straight away; otherwise its 64
+ *  pixels are written into the back buffer and it's added to the dirty list.
+ *  gfx_flush() walks the list and copies just those tiles out, 8 bytes per
+ *  pixel row, so a Sokoban move that changes two or three squares and a digit
+ *  of the move counter writes a few hundred bytes of VGA memory.
+ *
+ *  The sprites are drawn from the ASCII art in sprite_art once, into an atlas
+ *  of ready-made pixels, so drawing one is a plain copy. Text is drawn from
+ *  the font vga_set_mode13h() saved, squashed from 16 lines to 8 by or-ing
+ *  pairs of lines together like the 8x8 text modes do.
+ *
+ *  Everything is drawn with the 16 text mode colors, loaded into an unused
+ *  part of the DAC so that text mode's colors stay as they are.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug described in gfx.h
+ */
+#include <stddef.h>     /* NULL */
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint8_t, uint16_t, uint32_t */
+#include <string.h>     /* memcpy(), memset() */
+#include <asm.h>        /* disable_interrupts() */
+#include <eflags.h>     /* get_eflags(), set_eflags() */
+#include <console.h>    /* console_release_vga(), console_reclaim_vga() */
+#include <vga.h>        /* vga_set_mode13h(), vga_font_glyph(), ... */
+
+#include <gfx.h>
+
+/* number of text mode colors, and the first DAC entry they're loaded into */
+#define TEXT_COLORS     16
+#define PALETTE_BASE    64
+
+/* foreground and background of a text cell, the blink bit is ignored */
+#define CELL_FGND(cell) (((cell) >> 8) & 0x0F)
+#define CELL_BGND(cell) (((cell) >> 12) & 0x07)
+#define CELL_CHAR(cell) ((unsigned char)((cell) & 0xFF))
+
+/* tile_key values: text cells are their 16 bit cell value, sprites above */
+#define SPRITE_KEY(sprite)  (0x10000 | (uint32_t)(sprite))
+
+/* the 16 text mode colors, with 6 bits each of red, green and blue */
+static const uint8_t text_palette[TEXT_COLORS][3] = {
+    {  0,  0,  0 }, {  0,  0, 42 }, {  0, 42,  0 }, {  0, 42, 42 },
+    { 42,  0,  0 }, { 42,  0, 42 }, { 42, 21,  0 }, { 42, 42, 42 },
+    { 21, 21, 21 }, { 21, 21, 63 }, { 21, 63, 21 }, { 21, 63, 63 },
+    { 63, 21, 21 }, { 63, 21, 63 }, { 63, 63, 21 }, { 63, 63, 63 },
+};
+
+/* every sprite, one hex digit per pixel giving its text mode color */
+static const char *const sprite_art[GFX_SPRITE_COUNT][GFX_TILE_SIZE] = {
+    [GFX_SPRITE_FLOOR] = {
+        "00000000", "00000000", "00000000", "00000000",
+        "00000000", "00000000", "00000000", "00000000",
+    },
+    [GFX_SPRITE_WALL] = {
+        "88878887", "88878887", "77777777", "87888788",
+        "87888788", "77777777", "88878887", "88878887",
+    },
+    [GFX_SPRITE_BOX] = {
+        "66666666", "6e6666e6", "66e66e66", "666ee666",
+        "666ee666", "66e66e66", "6e6666e6", "66666666",
+    },
+    [GFX_SPRITE_GOAL] = {
+        "00000000", "000ee000", "00e00e00", "0e0000e0",
+        "0e0000e0", "00e00e00", "000ee000", "00000000",
+    },
+    [GFX_SPRITE_PLAYER] = {
+        "000bb000", "000bb000", "00bbbb00", "0b0bb0b0",
+        "000bb000", "00b00b00", "00b00b00", "0bb00bb0",
+    },
+    [GFX_SPRITE_BOX_ON_GOAL] = {
+        "22222222", "2a2222a2", "22a22a22", "222aa222",
+        "222aa222", "22a22a22", "2a2222a2", "22222222",
+    },
+};
+
+/* sprite_art turned into pixels */
+static uint8_t atlas[GFX_SPRITE_COUNT][GFX_TILE_SIZE][GFX_TILE_SIZE];
+static bool atlas_built = false;
+
+/* the screen as it will look after the next flush */
+static uint8_t back[VGA_MODE13H_HEIGHT][VGA_MODE13H_WIDTH];
+/* what each tile of back shows */
+static uint32_t tile_key[GFX_ROWS][GFX_COLS];
+/* tiles of back that differ from VGA memory, each listed once */
+static uint16_t dirty_list[GFX_ROWS * GFX_COLS];
+static int dirty_count = 0;
+static bool tile_dirty[GFX_ROWS][GFX_COLS];
+
+static bool active = false;
+
+/** @brief turns sprite_art into atlas
+ *
+ *  @return Void.
+ */
+static void build_atlas(void)
+{
+    int sprite, y, x;
+    for (sprite = 0; sprite < GFX_SPRITE_COUNT; sprite++) {
+        for (y = 0; y < GFX_TILE_SIZE; y++) {
+            for (x = 0; x < GFX_TILE_SIZE; x++) {
+                char digit = sprite_art[sprite][y][x];
+                int color = (digit >= 'a') ? digit - 'a' + 10 : digit - '0';
+                atlas[sprite][y][x] = PALETTE_BASE + color;
+            }
+        }
+    }
+    atlas_built = true;
+}
+
+/** @brief starts drawing a tile, unless it already shows the same thing
+ *
+ *  @param row row of the tile
+ *  @param col column of the tile
+ *  @param key what the tile is about to show
+ *  @return the top left pixel of the tile in back, or NULL if the tile is
+ *          out of range or already shows key
+ */
+static uint8_t *begin_tile(int row, int col, uint32_t key)
+{
+    if (row < 0 || row >= GFX_ROWS || col < 0 || col >= GFX_COLS) {
+        return NULL;
+    }
+    if (tile_key[row][col] == key) {
+        return NULL;
+    }
+    tile_key[row][col] = key;
+    if (!tile_dirty[row][col]) {
+        tile_dirty[row][col] = true;
+        dirty_list[dirty_count++] = row * GFX_COLS + col;
+    }
+    return &back[row * GFX_TILE_SIZE][col * GFX_TILE_SIZE];
+}
+
+void gfx_enter(void)
+{
+    if (active) {
+        return;
+    }
+    if (!atlas_built) {
+        build_atlas();
+    }
+    console_release_vga();
+
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    vga_set_mode13h();
+    vga_set_palette(PALETTE_BASE, text_palette, TEXT_COLORS);
+    set_eflags(eflags);
+
+    /* one full copy to get rid of whatever text mode left in VGA memory */
+    memset(back, PALETTE_BASE, sizeof(back));
+    memcpy((void*)VGA_MODE13H_MEM, back, sizeof(back));
+    int row, col;
+    for (row = 0; row < GFX_ROWS; row++) {
+        for (col = 0; col < GFX_COLS; col++) {
+            tile_key[row][col] = SPRITE_KEY(GFX_SPRITE_FLOOR);
+            tile_dirty[row][col] = false;
+        }
+    }
+    dirty_count = 0;
+    active = true;
+}
+
+void gfx_leave(void)
+{
+    if (!active) {
+        return;
+    }
+    active = false;
+    console_reclaim_vga();
+}
+
+bool gfx_active(void)
+{
+    return active;
+}
+
+void gfx_put_sprite(int row, int col, gfx_sprite_t sprite)
+{
+    if ((unsigned int)sprite >= GFX_SPRITE_COUNT) {
+        return;
+    }
+    uint8_t *dst = begin_tile(row, col, SPRITE_KEY(sprite));
+    if (dst == NULL) {
+        return;
+    }
+    int y;
+    for (y = 0; y < GFX_TILE_SIZE; y++) {
+        memcpy(dst, atlas[sprite][y], GFX_TILE_SIZE);
+        dst += VGA_MODE13H_WIDTH;
+    }
+}
+
+void gfx_put_cell(int row, int col, uint16_t cell)
+{
+    const uint8_t *glyph = vga_font_glyph(CELL_CHAR(cell));
+    if (glyph == NULL) {
+        return;
+    }
+    uint8_t *dst = begin_tile(row, col, cell);
+    if (dst == NULL) {
+        return;
+    }
+    uint8_t fgnd = PALETTE_BASE + CELL_FGND(cell);
+    uint8_t bgnd = PALETTE_BASE + CELL_BGND(cell);
+    int y, x;
+    for (y = 0; y < GFX_TILE_SIZE; y++) {
+        uint8_t bits = glyph[2 * y] | glyph[2 * y + 1];
+        for (x = 0; x < GFX_TILE_SIZE; x++) {
+            dst[x] = (bits & (0x80 >> x)) ? fgnd : bgnd;
+        }
+        dst += VGA_MODE13H_WIDTH;
+    }
+}
+
+int gfx_flush(void)
+{
+    if (!active) {
+        return 0;
+    }
+    uint8_t *vram = (uint8_t*)VGA_MODE13H_MEM;
+    int i;
+    for (i = 0; i < dirty_count; i++) {
+        int row = dirty_list[i] / GFX_COLS;
+        int col = dirty_list[i] % GFX_COLS;
+        int offset = row * GFX_TILE_SIZE * VGA_MODE13H_WIDTH +
+                     col * GFX_TILE_SIZE;
+        int y;
+        for (y = 0; y < GFX_TILE_SIZE; y++) {
+            memcpy(&vram[offset], (uint8_t*)back + offset, GFX_TILE_SIZE);
+            offset += VGA_MODE13H_WIDTH;
+        }
+        tile_dirty[row][col] = false;
+    }
+    int bytes = dirty_count * GFX_TILE_SIZE * GFX_TILE_SIZE;
+    dirty_count = 0;
+    return bytes;
+}
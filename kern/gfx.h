@@ -0,0 +1,87 @@
+/** @file gfx.h
+ *  @brief mode 13h tile renderer interface
+ *
+ *  Interface for drawing the screen as a grid of 8x8 pixel tiles in the VGA's
+ *  320x200 256 color mode. A tile is either one of a small set of sprites or
+ *  a text character in the console's colors. Tiles are drawn into a back
+ *  buffer in RAM, and only the tiles that changed since the last gfx_flush()
+ *  are copied out to VGA memory.
+ *
+ *  While the renderer is active, the console keeps drawing into its shadows
+ *  but leaves the VGA alone, see console_release_vga().
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug Going back to text mode redraws the whole text screen, so switching
+ *       back and forth costs a full screen copy each way.
+ */
+#ifndef __GFX_H_
+#define __GFX_H_
+
+#include <stdint.h>     /* uint16_t */
+#include <stdbool.h>    /* bool */
+
+/* pixels on a side of a tile, and tiles that fit on the screen */
+#define GFX_TILE_SIZE   8
+#define GFX_COLS        40
+#define GFX_ROWS        25
+
+/* pictures a tile can be drawn with besides text */
+typedef enum {
+    GFX_SPRITE_FLOOR,
+    GFX_SPRITE_WALL,
+    GFX_SPRITE_BOX,
+    GFX_SPRITE_GOAL,
+    GFX_SPRITE_PLAYER,
+    GFX_SPRITE_BOX_ON_GOAL,
+    GFX_SPRITE_COUNT,
+} gfx_sprite_t;
+
+/** @brief switches the VGA into mode 13h and clears the screen to floor
+ *
+ *  The console stops flushing until gfx_leave(). Does nothing if the
+ *  renderer is already active.
+ *
+ *  @return Void.
+ */
+void gfx_enter(void);
+/** @brief switches the VGA back to the console's text mode
+ *
+ *  Does nothing if the renderer isn't active.
+ *
+ *  @return Void.
+ */
+void gfx_leave(void);
+/** @brief tells whether the VGA is in mode 13h
+ *
+ *  @return whether gfx_enter() was called more recently than gfx_leave()
+ */
+bool gfx_active(void);
+/** @brief draws a sprite into a tile of the back buffer
+ *
+ *  Drawing the same thing a tile already shows costs nothing.
+ *
+ *  @param row row of the tile
+ *  @param col column of the tile
+ *  @param sprite sprite to draw
+ *  @return Void.
+ */
+void gfx_put_sprite(int row, int col, gfx_sprite_t sprite);
+/** @brief draws a text cell into a tile of the back buffer
+ *
+ *  The character is the text mode font squashed to 8 lines, drawn in the
+ *  cell's foreground and background colors. Drawing the same thing a tile
+ *  already shows costs nothing.
+ *
+ *  @param row row of the tile
+ *  @param col column of the tile
+ *  @param cell character and color, as built by CONSOLE_CELL()
+ *  @return Void.
+ */
+void gfx_put_cell(int row, int col, uint16_t cell);
+/** @brief copies every tile that changed out to VGA memory
+ *
+ *  @return number of bytes written to VGA memory
+ */
+int gfx_flush(void);
+
+#endif /* __GFX_H_ */
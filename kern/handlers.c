@@ -1,8 +1,9 @@
 /** @file handlers.c
  *  @brief handler_install implementation
  *
- *  Implementation for the handler_install function, which installs interrupt
- *  handlers for both the timer interrupt and keyboard interrupt.
+ *  Implementation for the handler_install function, which puts an entry stub
+ *  for every PIC line in the IDT and registers handlers for the timer,
+ *  keyboard and COM1 serial port interrupts with irq_register().
  *
  *  @author Bradley Zhou (bradleyz)
  *  @bug No known bugs.
@@ -11,16 +12,18 @@
 #include <stddef.h>             /* NULL */
 #include <stdint.h>             /* uint32_t, uint64_t */
 #include <stdbool.h>            /* bool */
-#include <asm.h>                /* inb(), outb() */
-#include <timer_defines.h>      /* TIMER_IDT_ENTRY */
-#include <interrupt_defines.h>  /* INT_CTL_PORT, INT_ACK_CURRENT */
+#include <asm.h>                /* inb() */
 #include <idt.h>                /* IDT_USER_START, IDT_ENTS */
 #include <seg.h>                /* SEGSEL_TSS, SEGSEL_KERNEL_CS */
-#include <keyhelp.h>            /* KEY_IDT_ENTRY, KEYBOARD_PORT */
+#include <keyhelp.h>            /* KEYBOARD_PORT */
+#include <x86/pic.h>            /* X86_PIC_MASTER_IRQ_BASE */
 
-#include <handlers_asm.h>
+#include <handlers_asm.h>       /* irq_stubs */
+#include <irq.h>                /* irq_register, IRQ_TIMER, IRQ_KEYBOARD */
 #include <timer.h>              /* timer_t, timer_initialize, timer_tick */
-#include <kb_buffer.h>          /* kb_buffer, kb_buf_initialize, kb_buf_write */
+#include <kb_buffer.h>          /* kb_buffer, kb_buf_write_batch */
+#include <compositor.h>         /* compositor_tick */
+#include <serial.h>             /* SERIAL_IRQ, serial_interrupt */
 
 /* size of all interrupt gates in bytes */
 #define GATE_SIZE       8
@@ -38,6 +41,19 @@
 /* segment selector startsa at index 16 in bottom 32 bits of interrupt gate */
 #define SEGSEL_SHIFT    16
 
+/* lines on each of the master and slave PICs */
+#define IRQ_PER_PIC             8
+
+/* keyboard controller status port, its bit for a byte being ready, and its
+ * bit for that byte having come from the mouse rather than the keyboard */
+#define KEYBOARD_STATUS_PORT    0x64
+#define KEYBOARD_OUTPUT_FULL    0x01
+#define KEYBOARD_AUX_DATA       0x20
+/* scancodes the keyboard handler gathers up before writing them out */
+#define KB_HANDLER_BATCH        8
+/* most bytes the keyboard handler reads in one interrupt */
+#define KB_HANDLER_MAX_READS    (4 * KB_HANDLER_BATCH)
+
 /* mask for bits 8, 9, 10 in the top 32 bits of the interrupt gate */
 typedef enum {
     TASK = 0x500,
@@ -126,36 +142,100 @@ static bool install_idt_km(void *base_addr,
     return true;
 }
 
+/** @brief gives the IDT entry the PICs deliver a line's interrupts at
+ *
+ *  @param irq line, 0 through IRQ_COUNT - 1
+ *  @return index in the IDT
+ */
+static unsigned int irq_idt_entry(int irq)
+{
+    if (irq < IRQ_PER_PIC) {
+        return X86_PIC_MASTER_IRQ_BASE + irq;
+    }
+    return X86_PIC_SLAVE_IRQ_BASE + (irq - IRQ_PER_PIC);
+}
+
 /** @brief C timer handler function
  *
- *  This is the handler function called by the assembly wrapper function that
- *  is invoked upon receiving a timer interrupt.
+ *  This is the handler irq_dispatch() calls upon receiving a timer interrupt.
  *
+ *  The compositor is ticked after the tickback so anything the tickback drew
+ *  makes it into a frame starting this tick rather than the next one.
+ *
+ *  @param ctx the timer to tick
  *  @return Void.
  */
-void timer_handler()
+static void timer_handler(void *ctx)
 {
-    timer_tick(&timer);
-    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+    timer_tick(ctx);
+    compositor_tick();
 }
 
 /** @brief C keyboard handler function
  *
- *  This is the handler function called by the assembly wrapper function that
- *  is invoked upon receiving a keyboard interrupt.
+ *  This is the handler irq_dispatch() calls upon receiving a keyboard
+ *  interrupt.
+ *
+ *  Rather than reading one scancode per interrupt, we keep reading for as long
+ *  as the controller's status says it has another one, so the bytes of an
+ *  extended key or the six of PAUSE usually all arrive in one interrupt. They
+ *  are gathered up and written to the buffer in batches. Stopping while the
+ *  controller still had a byte would leave its interrupt line high with no new
+ *  edge to interrupt us again, so we only stop early after
+ *  KB_HANDLER_MAX_READS bytes, which no real burst of keys comes near and
+ *  which keeps a status bit stuck on from hanging us here. Bytes the status
+ *  marks as mouse data are read, to get them out of the way, and thrown out.
+ *  An interrupt that finds no scancode to read is counted as spurious.
  *
- *  We call inb() before we check if the buffer is full because dropping
+ *  We read scancodes before we check if the buffer is full because dropping
  *  keypresses is preferable to blocking additional keypresses.
  *
+ *  @param ctx the keyboard buffer to write scancodes into
  *  @return Void.
  */
-void kb_handler()
+static void kb_handler(void *ctx)
 {
-    int keypress = inb(KEYBOARD_PORT);
-    if (!kb_buf_write(&kb_buffer, keypress)) {
-        /* nothing to do if write fails, we can just drop the keypress */
+    kb_buf_t *kb_buf = ctx;
+    int keypresses[KB_HANDLER_BATCH];
+    int n = 0;
+    bool any = false;
+    int reads;
+    for (reads = 0; reads < KB_HANDLER_MAX_READS; reads++) {
+        uint8_t status = inb(KEYBOARD_STATUS_PORT);
+        if (!(status & KEYBOARD_OUTPUT_FULL)) {
+            break;
+        }
+        uint8_t byte = inb(KEYBOARD_PORT);
+        if (status & KEYBOARD_AUX_DATA) {
+            continue;
+        }
+        keypresses[n++] = byte;
+        any = true;
+        if (n == KB_HANDLER_BATCH) {
+            kb_buf_write_batch(kb_buf, keypresses, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        kb_buf_write_batch(kb_buf, keypresses, n);
+    }
+    if (!any) {
+        kb_buf_count_spurious(kb_buf);
     }
-    outb(INT_CTL_PORT, INT_ACK_CURRENT);
+}
+
+/** @brief C serial port handler function
+ *
+ *  This is the handler irq_dispatch() calls upon receiving a COM1 interrupt,
+ *  which only ever comes when the UART wants more output. The UART doesn't
+ *  raise it at all unless a serial sink was enabled.
+ *
+ *  @param ctx unused
+ *  @return Void.
+ */
+static void serial_handler(void *ctx)
+{
+    serial_interrupt();
 }
 
 int handler_install(void (*tickback)(unsigned int))
@@ -172,13 +252,21 @@ int handler_install(void (*tickback)(unsigned int))
 
     timer_set_tickback(&timer, tickback);
 
-    void *base_addr = idt_base();
+    irq_register(IRQ_TIMER, timer_handler, &timer);
+    irq_register(IRQ_KEYBOARD, kb_handler, &kb_buffer);
+    irq_register(SERIAL_IRQ, serial_handler, NULL);
 
-    if (!install_idt_km(base_addr, TIMER_IDT_ENTRY, timer_handler_wrapper)) {
-        return -1;
-    }
-    if (!install_idt_km(base_addr, KEY_IDT_ENTRY, kb_handler_wrapper)) {
-        return -1;
+    /**
+     *  Every line gets a stub, even the ones nothing is registered for yet,
+     *  so a stray interrupt from one of them is acknowledged instead of
+     *  landing on an empty IDT entry.
+     */
+    void *base_addr = idt_base();
+    int irq;
+    for (irq = 0; irq < IRQ_COUNT; irq++) {
+        if (!install_idt_km(base_addr, irq_idt_entry(irq), irq_stubs[irq])) {
+            return -1;
+        }
     }
 
     return 0;
@@ -1,10 +1,9 @@
 /** @file handlers_asm.h
- *  @brief function prototypes for asm interrupt handler wrapper functions
+ *  @brief declarations for the asm interrupt entry stubs
  *
- *  This file contains the function prototype declarations for asm wrapper
- *  functions that call C code as interrupt handlers. There are prototypes
- *  for the timer interrupt handler wrapper and the keyboard interrupt handler
- *  wrapper.
+ *  This file declares the table of entry stubs, one for each of the 16 PIC
+ *  lines, that handlers_asm.S generates. Each one calls into C through
+ *  irq_dispatch().
  *
  *  @author Bradley Zhou (bradleyz)
  *  @bug No known bugs.
@@ -12,27 +11,17 @@
 #ifndef __HANDLERS_ASM_H_
 #define __HANDLERS_ASM_H_
 
-/** @brief Wrapper function to setup stack and call C timer_handler function
- * 
- *  Since our timer_handler will be clobbering the values of the general purpose
- *  registers, we need to save those on the stack before we start executing our
- *  timer_handler code. Those registers are saved with the pusha instruction,
- *  restored with the popa instruction after the C function returns, and then
- *  the iret instruction is called to return back to where interrupt occurred.
- * 
- *  @return Void.
- */
-void timer_handler_wrapper(void);
-void kb_handler_wrapper(void);
+#include <irq.h>        /* IRQ_COUNT */
 
-/** @brief Wrapper function to setup stack and call C kb_handler function
- * 
- *  Since our kb_handler will be clobbering the values of the general purpose
- *  registers, we need to save those on the stack before we start executing our
- *  kb_handler code. Those registers are saved with the pusha instruction,
- *  restored with the popa instruction after the C function returns, and then
- *  the iret instruction is called to return back to where interrupt occurred.
- * 
- *  @return Void.
+/** @brief Entry stubs for the PIC lines, indexed by IRQ number
+ *
+ *  Since irq_dispatch() and the handlers it calls will be clobbering the
+ *  values of the general purpose registers, each stub saves those on the
+ *  stack with the pusha instruction, pushes its IRQ number and calls
+ *  irq_dispatch(), restores them with the popa instruction after the C
+ *  function returns, and then the iret instruction is called to return back
+ *  to where interrupt occurred.
  */
+extern void (*const irq_stubs[IRQ_COUNT])(void);
+
 #endif /* __HANDLERS_ASM_H_ */
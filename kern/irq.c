@@ -0,0 +1,127 @@
+/** @file irq.c
+ *  @brief hardware interrupt dispatch implementation
+ *
+ *  The handler table is only read by irq_dispatch(), and irq_register()
+ *  changes an entry with interrupts disabled, so a handler is never called
+ *  with another handler's ctx.
+ *
+ *  A line's stats are updated before it is acknowledged. Until then the PIC
+ *  won't deliver that line again, so nothing else ever writes them at the
+ *  same time, and irq_get_stats() only has to keep the dispatch from running
+ *  while it copies them.
+ *
+ *  IRQ 7 and IRQ 15 are also what the PICs raise when a line drops again
+ *  before they can tell which it was. Those spurious ones don't set the
+ *  line's in-service bit, so they must not be acknowledged; a spurious IRQ 15
+ *  still came through the master's cascade line, so the master is.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug described in irq.h
+ */
+#include <stddef.h>     /* NULL */
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint32_t, uint64_t */
+#include <asm.h>        /* inb(), outb(), rdtsc(), disable_interrupts() */
+#include <eflags.h>     /* get_eflags(), set_eflags() */
+#define X86_PIC_DEFINITIONS
+#include <x86/pic.h>    /* pic_acknowledge(), OCW3 bits */
+
+#include <irq.h>
+
+/* lines the PICs report spurious interrupts on, one for each PIC */
+#define IRQ_SPURIOUS_MASTER 7
+#define IRQ_SPURIOUS_SLAVE  15
+/* in-service bit of the last line on either PIC */
+#define ISR_LAST_LINE       0x80
+/* the master's line the slave is cascaded into */
+#define IRQ_CASCADE         2
+
+/* a registered handler and what to pass it */
+typedef struct {
+    irq_handler_t handler;
+    void *ctx;
+} irq_entry_t;
+
+static irq_entry_t entries[IRQ_COUNT];
+static irq_stats_t irq_stats[IRQ_COUNT];
+
+/** @brief reads a PIC's in-service register
+ *
+ *  @param icw_port command port of the PIC to read
+ *  @return lines the PIC currently has in service, one bit each
+ */
+static uint8_t pic_read_isr(uint16_t icw_port)
+{
+    outb(icw_port, OCW_TEMPLATE | READ_NEXT_RD | READ_IS_ONRD);
+    return inb(icw_port);
+}
+
+/** @brief tells whether an interrupt on irq really came from a device
+ *
+ *  @param irq line that interrupted
+ *  @return false if the PIC raised it without the line being in service
+ */
+static bool irq_is_real(unsigned int irq)
+{
+    if (irq == IRQ_SPURIOUS_MASTER) {
+        return pic_read_isr(MASTER_ICW) & ISR_LAST_LINE;
+    }
+    if (irq == IRQ_SPURIOUS_SLAVE) {
+        return pic_read_isr(SLAVE_ICW) & ISR_LAST_LINE;
+    }
+    return true;
+}
+
+int irq_register(int irq, irq_handler_t handler, void *ctx)
+{
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return -1;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    entries[irq].handler = handler;
+    entries[irq].ctx = ctx;
+    set_eflags(eflags);
+    return 0;
+}
+
+void irq_dispatch(unsigned int irq)
+{
+    if (irq >= IRQ_COUNT) {
+        return;
+    }
+    irq_stats_t *s = &irq_stats[irq];
+    if (!irq_is_real(irq)) {
+        s->spurious++;
+        if (irq == IRQ_SPURIOUS_SLAVE) {
+            pic_acknowledge(IRQ_CASCADE);
+        }
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    irq_entry_t entry = entries[irq];
+    if (entry.handler != NULL) {
+        entry.handler(entry.ctx);
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    s->count++;
+    s->total_cycles += cycles;
+    if (cycles > s->max_cycles) {
+        s->max_cycles = cycles;
+    }
+    pic_acknowledge(irq);
+}
+
+int irq_get_stats(int irq, irq_stats_t *stats)
+{
+    if (irq < 0 || irq >= IRQ_COUNT) {
+        return -1;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    *stats = irq_stats[irq];
+    set_eflags(eflags);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/** @file irq.h
+ *  @brief hardware interrupt dispatch interface
+ *
+ *  Interface for handling the 16 lines of the PICs without writing a new
+ *  assembly wrapper for each device. handler_install() puts a generic entry
+ *  stub for every line in the IDT, at X86_PIC_MASTER_IRQ_BASE through
+ *  X86_PIC_SLAVE_IRQ_BASE + 7, which calls irq_dispatch() with its IRQ
+ *  number. irq_dispatch() looks the
+ *  line up in a table of registered handlers, calls it, keeps track of how
+ *  often and for how long each line's handler runs, and acknowledges the
+ *  right PIC (or both) afterwards. Drivers only ever write a C handler and
+ *  call irq_register().
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug Handlers run in trap gates with interrupts still enabled, so a
+ *       higher priority line's handler can run in the middle of a lower
+ *       one's, and its cycles are counted in both.
+ */
+#ifndef __IRQ_H_
+#define __IRQ_H_
+
+#include <stdint.h>     /* uint64_t */
+
+/* number of lines across the master and slave PICs */
+#define IRQ_COUNT 16
+
+/* lines with a fixed device on a PC */
+#define IRQ_TIMER       0
+#define IRQ_KEYBOARD    1
+
+/* a device's interrupt handler, passed whatever was given to irq_register() */
+typedef void (*irq_handler_t)(void *ctx);
+
+/* how much one line has been interrupting */
+typedef struct {
+    unsigned int count;     /* interrupts handled */
+    unsigned int spurious;  /* IRQ 7/15 that no device had actually raised */
+    uint64_t total_cycles;  /* time stamp counter cycles spent in handler */
+    uint64_t max_cycles;    /* longest single run of the handler */
+} irq_stats_t;
+
+/** @brief sets the handler for one PIC line
+ *
+ *  Replaces any handler the line had. A line without a handler is still
+ *  counted and acknowledged when it fires, it just does nothing else.
+ *
+ *  @param irq line to handle, 0 through IRQ_COUNT - 1
+ *  @param handler function to call for each interrupt, NULL for none
+ *  @param ctx passed to handler as is
+ *  @return 0 on success, negative if irq is out of range
+ */
+int irq_register(int irq, irq_handler_t handler, void *ctx);
+/** @brief runs the handler for a PIC line and then acknowledges it
+ *
+ *  @pre called from the line's entry stub
+ *  @param irq line that interrupted
+ *  @return Void.
+ */
+void irq_dispatch(unsigned int irq);
+/** @brief copies out how much a line has been interrupting
+ *
+ *  @param irq line to look at
+ *  @param stats where to copy its counts
+ *  @return 0 on success, negative if irq is out of range
+ */
+int irq_get_stats(int irq, irq_stats_t *stats);
+
+#endif /* __IRQ_H_ */
@@ -1,31 +1,190 @@
 /** @file kb.c
  *  @brief keyboard driver implementation
  *
- *  Keyboard driver consists of only one function: readchar(). This function
- *  will continually poll a queue of keypresses until it determines a valid char
- *  has been pressed down, at which point, it returns that char. If there are no
- *  keypresses, the function returns -1 immediately.
+ *  The keyboard handler only queues raw scancodes, each stamped with when it
+ *  arrived. Decoding them is left to kb_drain(), the driver's bottom half,
+ *  which runs outside the interrupt and turns everything that's waiting into
+ *  key events in one go. readchar() and read_key_events() both drain first
+ *  and then read from the event queue, so readchar() returns the next key
+ *  press as a char, or -1 immediately if there are none.
+ *
+ *  Shift+PgUp and Shift+PgDn never make it into the event queue; they move
+ *  the console's view through its scrollback history instead. Neither do
+ *  Alt+F1 through Alt+F4, which switch between the virtual consoles.
+ *
+ *  The event queue is only ever touched outside of interrupts, so its
+ *  free-running indices need no protection.
+ *
+ *  kb_drain() also keeps a bitmap of which keys are down, indexed by raw
+ *  code, setting a key's bit on make and clearing it on break. Modifiers and
+ *  console keys are counted too, since they really are held down, even
+ *  though neither is ever queued. Keys keyhelp has no raw code for all come
+ *  back as KHE_UNDEFINED and aren't tracked.
+ *
+ *  wait_for_input() looks for input with interrupts disabled and then sleeps
+ *  with sti_hlt(), so a keypress arriving right after the check still wakes
+ *  it rather than waiting for the next timer tick.
  *
  *  @author Bradley Zhou (bradleyz)
- *  @bug No known bugs.
+ *  @bug described in kb.h
  */
 #include <p1kern.h>     /* declaration for readchar() */
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint32_t */
 #include <kb_buffer.h>  /* kb_buf_t, kb_buf_read() */
 #include <keyhelp.h>    /* kh_type, KH_HASDATA(), KH_ISMAKE(), KH_GETCHAR() */
+#include <console.h>    /* console_scroll_view(), console_switch() */
+#include <asm.h>        /* disable_interrupts(), enable_interrupts() */
+#include <timer.h>      /* timer */
+#include <cpu_asm.h>    /* sti_hlt() */
+
+#include <kb.h>
+
+#define EVENT_MASK (KEY_EVENT_QUEUE_SIZE - 1)
 
 /* global keyboard buffer that we poll for new keypresses */
 kb_buf_t kb_buffer;
+/* timer declared in timer.h */
+extern timer_t timer;
 
-int readchar(void)
+/* decoded key events, indexed by the free-running head and tail */
+static key_event_t events[KEY_EVENT_QUEUE_SIZE];
+static unsigned int event_head = 0;
+static unsigned int event_tail = 0;
+
+/* which keys are down, as of the last kb_drain() */
+static key_bitmap_t key_state;
+
+/** @brief handles the keys that control the console instead of the game
+ *
+ *  Shift+PgUp/Shift+PgDn move the shown console's scrollback view, and
+ *  Alt+F1 through Alt+F4 switch to that virtual console.
+ *
+ *  @param aug_char processed make event
+ *  @return whether the key was a console key and has been handled
+ */
+static bool handle_console_key(kh_type aug_char)
 {
+    int raw = KH_GETRAW(aug_char);
+    if (KH_SHIFT(aug_char)) {
+        switch (raw) {
+            case KHE_PAGE_UP:
+                console_scroll_view(-CONSOLE_SCROLLBACK_PAGE);
+                return true;
+            case KHE_PAGE_DOWN:
+                console_scroll_view(CONSOLE_SCROLLBACK_PAGE);
+                return true;
+            default:
+                return false;
+        }
+    }
+    if (KH_ALT(aug_char) && raw >= KHE_F1 && raw <= KHE_F4) {
+        console_switch(raw - KHE_F1);
+        return true;
+    }
+    return false;
+}
+
+int kb_drain(void)
+{
+    int queued = 0;
     int curr_scancode;
-    kh_type aug_char;
-    /* while the buffer is not empty */
-    while (kb_buf_read(&kb_buffer, &curr_scancode)) {
-        aug_char = process_scancode(curr_scancode);
-        if (KH_HASDATA(aug_char) && KH_ISMAKE(aug_char)) {
-            return KH_GETCHAR(aug_char);
+    kb_stamp_t stamp;
+    while (kb_buf_read(&kb_buffer, &curr_scancode, &stamp)) {
+        kh_type aug_char = process_scancode(curr_scancode);
+        bool make = KH_ISMAKE(aug_char);
+        int raw = KH_GETRAW(aug_char);
+        /* modifiers come back with a raw code but no data, so check first */
+        if (KH_HASRAW(aug_char) && raw != KHE_UNDEFINED) {
+            uint32_t bit = 1u << (raw % 32);
+            if (make) {
+                key_state.words[raw / 32] |= bit;
+            } else {
+                key_state.words[raw / 32] &= ~bit;
+            }
+        }
+        if (!KH_HASDATA(aug_char)) {
+            continue;
+        }
+        if (make && handle_console_key(aug_char)) {
+            continue;
+        }
+        if (event_head - event_tail == KEY_EVENT_QUEUE_SIZE) {
+            /* just drop the event if the queue is full */
+            continue;
+        }
+        key_event_t *event = &events[event_head & EVENT_MASK];
+        event->key = aug_char;
+        event->make = make;
+        event->tick = stamp.tick;
+        event->tsc = stamp.tsc;
+        event_head++;
+        queued++;
+    }
+    return queued;
+}
+
+int read_key_events(key_event_t *buf, int n)
+{
+    kb_drain();
+    int count = 0;
+    while (count < n && event_tail != event_head) {
+        buf[count++] = events[event_tail & EVENT_MASK];
+        event_tail++;
+    }
+    return count;
+}
+
+bool is_key_down(int key)
+{
+    if (key < 0 || key >= KEY_STATE_KEYS) {
+        return false;
+    }
+    return (key_state.words[key / 32] >> (key % 32)) & 1;
+}
+
+void key_snapshot(key_bitmap_t *bitmap)
+{
+    kb_drain();
+    *bitmap = key_state;
+}
+
+int readchar(void)
+{
+    kb_drain();
+    while (event_tail != event_head) {
+        key_event_t *event = &events[event_tail & EVENT_MASK];
+        event_tail++;
+        if (event->make) {
+            return KH_GETCHAR(event->key);
         }
     }
     return -1;
 }
+
+int wait_for_input(int timeout_ticks)
+{
+    unsigned int start = timer.numTicks;
+    while (1) {
+        disable_interrupts();
+        if (event_tail != event_head || !kb_buf_empty(&kb_buffer)) {
+            enable_interrupts();
+            return 1;
+        }
+        if (timeout_ticks >= 0 &&
+            timer.numTicks - start >= (unsigned int)timeout_ticks) {
+            enable_interrupts();
+            return 0;
+        }
+        sti_hlt();
+    }
+}
+
+int readchar_blocking(void)
+{
+    int ch;
+    while ((ch = readchar()) == -1) {
+        wait_for_input(-1);
+    }
+    return ch;
+}
@@ -0,0 +1,99 @@
+/** @file kb.h
+ *  @brief keyboard driver interface
+ *
+ *  Interface for the parts of the keyboard driver beyond readchar(). Raw
+ *  scancodes queued by the keyboard handler are decoded in bulk by
+ *  kb_drain() into a queue of key events, each one a key going down or up
+ *  along with when its scancode arrived. readchar() hands out the presses one
+ *  character at a time; read_key_events() hands out everything in batches.
+ *  Which keys are down right now is kept as a bitmap alongside, for code
+ *  that would rather poll once a frame with is_key_down() or key_snapshot().
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug Once the event queue is full, further events are dropped until
+ *       somebody reads some, the same as the scancode buffer.
+ */
+#ifndef __KB_H_
+#define __KB_H_
+
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint32_t, uint64_t */
+#include <keyhelp.h>    /* kh_type */
+
+/* number of decoded key events that can be waiting, a power of two */
+#define KEY_EVENT_QUEUE_SIZE 256
+
+/* keys tracked by the key state bitmap, one per possible raw code */
+#define KEY_STATE_KEYS 256
+#define KEY_STATE_WORDS (KEY_STATE_KEYS / 32)
+
+/* which keys are down, bit (raw % 32) of word (raw / 32) for each raw code */
+typedef struct {
+    uint32_t words[KEY_STATE_WORDS];
+} key_bitmap_t;
+
+/* a key going down or coming back up */
+typedef struct {
+    kh_type key;        /* as returned by process_scancode() */
+    bool make;          /* whether the key went down rather than up */
+    unsigned int tick;  /* timer tick its scancode arrived on */
+    uint64_t tsc;       /* time stamp counter when its scancode arrived */
+} key_event_t;
+
+/** @brief decodes every scancode waiting in the keyboard buffer
+ *
+ *  Scancodes that finish a key event are queued as one; the rest (prefix
+ *  bytes, and keys keyhelp has nothing for) only update the decoder's state.
+ *  Presses of the keys that control the console, Shift+PgUp/Shift+PgDn and
+ *  Alt+F1 through Alt+F4, are acted on here and never queued.
+ *
+ *  @return number of events queued
+ */
+int kb_drain(void);
+/** @brief takes up to n key events off the queue, oldest first
+ *
+ *  Drains the keyboard buffer first, so nothing that has arrived is missed.
+ *
+ *  @param buf where to store the events
+ *  @param n most events to store
+ *  @return number of events stored, 0 if there were none or n isn't positive
+ */
+int read_key_events(key_event_t *buf, int n);
+/** @brief sleeps until there is keyboard input or enough ticks have passed
+ *
+ *  The processor is halted in between interrupts instead of spinning, and
+ *  wakes up on every one of them to check again. Any scancode counts as
+ *  input, so this can return for a key release that readchar() then skips.
+ *
+ *  @pre interrupts are enabled, or nothing would ever wake us
+ *  @param timeout_ticks most timer ticks to wait, or negative to wait for as
+ *         long as it takes
+ *  @return 1 if there is input to read, 0 if the timeout ran out first
+ */
+int wait_for_input(int timeout_ticks);
+/** @brief tells whether a key is being held down
+ *
+ *  Only looks at the bitmap, so it is as of the last time the keyboard
+ *  buffer was drained; key_snapshot() drains first.
+ *
+ *  @param key raw code of the key, as given by KH_GETRAW()
+ *  @return whether the key is down, false if key isn't a raw code
+ */
+bool is_key_down(int key);
+/** @brief copies out which keys are down right now
+ *
+ *  Drains the keyboard buffer first, so the snapshot covers every scancode
+ *  that has arrived.
+ *
+ *  @param bitmap where to copy the key state bitmap
+ *  @return Void.
+ */
+void key_snapshot(key_bitmap_t *bitmap);
+/** @brief like readchar(), but sleeps until there's a key press to return
+ *
+ *  @pre interrupts are enabled
+ *  @return the next key press
+ */
+int readchar_blocking(void);
+
+#endif /* __KB_H_ */
@@ -2,24 +2,40 @@
  *  @brief keyboard buffer implementation
  *
  *  Implementation for the keyboard buffer defined in kb_buffer.h. This is a
- *  pretty simple and standard circular buffer.
+ *  pretty simple and standard circular buffer, with a power of two size so
+ *  indices are wrapped by masking them.
+ *
+ *  The stats are only ever written by the producer, the keyboard handler, so
+ *  they need no more protection than the write_index does.
  *
  *  @author Bradley Zhou (bradleyz)
  *  @bug described in kb_buffer.h
  */
 #include <kb_buffer.h>
+#include <stddef.h>     /* NULL */
+#include <stdint.h>     /* uint32_t */
+#include <asm.h>        /* rdtsc(), disable_interrupts() */
+#include <eflags.h>     /* get_eflags(), set_eflags() */
+#include <timer.h>      /* timer */
+
+/* timer declared in timer.h */
+extern timer_t timer;
 
 void kb_buf_initialize(kb_buf_t *kb_buf)
 {
     /* initially, a circular buffer starts out with read/write index as 0 */
     kb_buf->read_index = 0;
     kb_buf->write_index = 0;
+    kb_buf->stats.writes = 0;
+    kb_buf->stats.drops = 0;
+    kb_buf->stats.high_water = 0;
+    kb_buf->stats.spurious = 0;
 }
 
-bool kb_buf_read(kb_buf_t *kb_buf, int *read_result)
+bool kb_buf_read(kb_buf_t *kb_buf, int *read_result, kb_stamp_t *stamp)
 {
-    int read_index = kb_buf->read_index;
-    int write_index = kb_buf->write_index;
+    unsigned int read_index = kb_buf->read_index;
+    unsigned int write_index = kb_buf->write_index;
 
     /* a circ buffer is empty when the read_index equals write_index */
     if (read_index == write_index) {
@@ -28,35 +44,83 @@ bool kb_buf_read(kb_buf_t *kb_buf, int *read_result)
 
     /**
      *  Read value before incrementing read_index because otherwise, a write
-     *  in between the increment and the read could mistakenly classify the
-     *  buffer as full when it is not, though this case is not nearly as bad as
-     *  in kb_buf_write. In this case, we might just drop slightly more keypress
-     *  events than necessary.
+     *  in between the increment and the read could overwrite the slot before
+     *  we got to read it.
      */
-    *read_result = kb_buf->keypress_queue[read_index];
-    kb_buf->read_index = (read_index + 1) % CIRCULAR_BUFFER_SIZE;
+    unsigned int slot = read_index & CIRCULAR_BUFFER_MASK;
+    *read_result = kb_buf->keypress_queue[slot];
+    if (stamp != NULL) {
+        *stamp = kb_buf->stamps[slot];
+    }
+    kb_buf->read_index = read_index + 1;
     return true;
 }
 
+bool kb_buf_empty(const kb_buf_t *kb_buf)
+{
+    return kb_buf->read_index == kb_buf->write_index;
+}
+
 bool kb_buf_write(kb_buf_t *kb_buf, int keypress)
 {
-    int read_index = kb_buf->read_index;
-    int write_index = kb_buf->write_index;
+    return kb_buf_write_batch(kb_buf, &keypress, 1) == 1;
+}
 
-    /* a circ buffer is full when the read_index is 1 less than write_index */
-    if ((read_index + 1) % CIRCULAR_BUFFER_SIZE == write_index) {
-        /* just drop keypress event if buffer is full */
-        return false;
+int kb_buf_write_batch(kb_buf_t *kb_buf, const int *keypresses, int n)
+{
+    if (n <= 0) {
+        return 0;
+    }
+    unsigned int read_index = kb_buf->read_index;
+    unsigned int write_index = kb_buf->write_index;
+
+    /* a circ buffer is full when write_index is a whole buffer ahead */
+    unsigned int used = write_index - read_index;
+    unsigned int room = CIRCULAR_BUFFER_SIZE - used;
+    unsigned int count = (unsigned int)n;
+    if (count > room) {
+        /* just drop the keypress events that don't fit */
+        kb_buf->stats.drops += count - room;
+        count = room;
+    }
+    if (count == 0) {
+        return 0;
     }
 
     /**
-     *  We want to write the scancode into the buffer THEN increment the
+     *  We want to write the scancodes into the buffer THEN increment the
      *  write_index. If we don't, a situation could arise where we write into an 
      *  empty buffer, increment write_index, and then get a read call, which
      *  gets the incorrect value from the buffer as the correct value has not
      *  been written there yet.
      */
-    kb_buf->keypress_queue[write_index] = keypress;
-    kb_buf->write_index = (write_index + 1) % CIRCULAR_BUFFER_SIZE;
-    return true;
+    kb_stamp_t stamp;
+    stamp.tick = timer.numTicks;
+    stamp.tsc = rdtsc();
+    unsigned int i;
+    for (i = 0; i < count; i++) {
+        unsigned int slot = (write_index + i) & CIRCULAR_BUFFER_MASK;
+        kb_buf->keypress_queue[slot] = keypresses[i];
+        kb_buf->stamps[slot] = stamp;
+    }
+    kb_buf->write_index = write_index + count;
+
+    kb_buf->stats.writes += count;
+    if (used + count > kb_buf->stats.high_water) {
+        kb_buf->stats.high_water = used + count;
+    }
+    return count;
+}
+
+void kb_buf_count_spurious(kb_buf_t *kb_buf)
+{
+    kb_buf->stats.spurious++;
+}
+
+void kb_buf_get_stats(const kb_buf_t *kb_buf, kb_buf_stats_t *stats)
+{
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+    *stats = kb_buf->stats;
+    set_eflags(eflags);
 }
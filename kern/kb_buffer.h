@@ -29,38 +29,62 @@
  *       up. If the buffer is full, then the keypress scancode is just dropped.
  *       This could lead to unintended behaviors such as a press event not
  *       having an associated release event or a modifier key (shift/ctrl/etc)
- *       modifying an unintended key.
+ *       modifying an unintended key. Drops are at least counted, see
+ *       kb_buf_get_stats().
  */
 #ifndef __KB_BUFFER_H_
 #define __KB_BUFFER_H_
 
 #include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint64_t */
 
 /**
- *  keyhelp.h defines 127 possible keys in the kh_extended_e enum, round up for
- *  nice power of two
+ *  Log base 2 of the number of scancodes the buffer holds, so the size is
+ *  always a power of two and indices wrap with a mask instead of a divide.
+ *  The default of 8 gives 256, room for a press and a release of each of the
+ *  128 keys keyhelp knows about. Build with -DKB_BUF_ORDER=n to try others;
+ *  kb_buf_get_stats() tells how close the buffer has come to filling.
  */
-#define TOTAL_KEYS 128
+#ifndef KB_BUF_ORDER
+#define KB_BUF_ORDER 8
+#endif
+#define CIRCULAR_BUFFER_SIZE (1u << KB_BUF_ORDER)
+#define CIRCULAR_BUFFER_MASK (CIRCULAR_BUFFER_SIZE - 1)
+
+/* when a scancode arrived, recorded by kb_buf_write() */
+typedef struct {
+    unsigned int tick;  /* timer ticks since boot */
+    uint64_t tsc;       /* time stamp counter */
+} kb_stamp_t;
+
+/* what has happened to a keyboard buffer since it was initialized */
+typedef struct {
+    unsigned int writes;        /* scancodes written */
+    unsigned int drops;         /* scancodes dropped because it was full */
+    unsigned int high_water;    /* most scancodes it has held at once */
+    unsigned int spurious;      /* keyboard interrupts that brought nothing */
+} kb_buf_stats_t;
+
 /**
- *  The logic behind this choice was to be able to store one press/release event
- *  for each possible key. Doesn't account the possiblity of pressing and
- *  releasing the same key multiple times without being processed, leading to
- *  the potential buf as described in the top.
+ *  circular buffer struct
+ *
+ *  The indices are free-running and only masked when used, so the number of
+ *  scancodes in the buffer is always write_index - read_index, even after
+ *  they wrap around, and all CIRCULAR_BUFFER_SIZE slots can be used.
  */
-#define CIRCULAR_BUFFER_SIZE (TOTAL_KEYS * 2)
-
-/* circular buffer struct */
 typedef struct {
     int keypress_queue[CIRCULAR_BUFFER_SIZE];
-    int read_index;
-    int write_index;
+    kb_stamp_t stamps[CIRCULAR_BUFFER_SIZE];
+    unsigned int read_index;
+    unsigned int write_index;
+    kb_buf_stats_t stats;
 } kb_buf_t;
 
 /** @brief initialize the keyboard buffer
  *
  *  C doesn't have elegant default constructors :( so this function just zero's
  *  out read_index and write_index of the buffer passed in, which is the state
- *  a circular buffer should be at first.
+ *  a circular buffer should be at first, along with its stats.
  *
  *  @param kb_buf pointer to buffer to initialize
  *  @return Void.
@@ -70,23 +94,58 @@ void kb_buf_initialize(kb_buf_t *kb_buf);
  *
  *  If the queue is empty, false is returned. Otherwise, read the next keypress
  *  scancode from the queue, store it into read_result, and return true. The
- *  read_index is then incremented, wrapping back to 0 if necessary.
+ *  read_index is then incremented.
  *
  *  @param kb_buf pointer to keyboard buffer to try to read next scancode from
  *  @param read_result pointer to int to store scancode at if buffer is not full
+ *  @param stamp where to store when the scancode arrived, or NULL
  *  @return whether or not the read was successful (if the buffer was nonempty)
  */
-bool kb_buf_read(kb_buf_t *kb_buf, int *read_result);
+bool kb_buf_read(kb_buf_t *kb_buf, int *read_result, kb_stamp_t *stamp);
+/** @brief tells whether the keyboard buffer has any scancodes in it
+ *
+ *  @param kb_buf pointer to keyboard buffer to look at
+ *  @return whether a kb_buf_read() would succeed
+ */
+bool kb_buf_empty(const kb_buf_t *kb_buf);
 /** @brief writes a keypress scancode into the keyboard buffer
  *
- *  If the queue is full, false is returned. Otherwise, write the keypress event
- *  into the buffer and return true. The write_index is then incremented,
- *  wrapping back to 0 if necessary.
+ *  If the queue is full, the drop is counted and false is returned. Otherwise,
+ *  write the keypress event into the buffer, along with the current tick and
+ *  time stamp counter, and return true. The write_index is then incremented.
  *
  *  @param kb_buf pointer to keyboard buffer to try to write keypress into
  *  @param keypress scancode to tryto write
  *  @return whether or not the write was successful (if the buffer was not full)
  */
 bool kb_buf_write(kb_buf_t *kb_buf, int keypress);
+/** @brief writes several keypress scancodes into the keyboard buffer at once
+ *
+ *  Like n calls to kb_buf_write(), except the indices are only loaded and
+ *  stored once and every scancode gets the same stamp. Scancodes that don't
+ *  fit are dropped, and counted, from the end.
+ *
+ *  @param kb_buf pointer to keyboard buffer to try to write keypresses into
+ *  @param keypresses scancodes to try to write, oldest first
+ *  @param n number of scancodes in keypresses
+ *  @return number of scancodes written
+ */
+int kb_buf_write_batch(kb_buf_t *kb_buf, const int *keypresses, int n);
+/** @brief counts a keyboard interrupt that found no scancode to read
+ *
+ *  @param kb_buf pointer to keyboard buffer the interrupt was for
+ *  @return Void.
+ */
+void kb_buf_count_spurious(kb_buf_t *kb_buf);
+/** @brief copies out a keyboard buffer's write, drop and other counts
+ *
+ *  Taken with interrupts disabled, so the counts are consistent with each
+ *  other even while the keyboard handler is writing.
+ *
+ *  @param kb_buf pointer to keyboard buffer to look at
+ *  @param stats where to store the counts
+ *  @return Void.
+ */
+void kb_buf_get_stats(const kb_buf_t *kb_buf, kb_buf_stats_t *stats);
 
 #endif /* __KB_BUFFER_H_ */
@@ -0,0 +1,205 @@
+/** @file readline.c
+ *  @brief cooked mode line editor implementation
+ *
+ *  The line being edited is kept in the caller's buffer, and where it starts
+ *  on screen is kept as a cell number (row * width + col), so the screen
+ *  position of any character in it is just an addition away and the cursor
+ *  can be moved there directly. Output can scroll the screen, so after
+ *  anything is echoed the start is worked out again from where the console
+ *  left its cursor.
+ *
+ *  Typing or deleting at the end of the line is echoed as is; deleting there
+ *  is just a '\b', which the console knows to take back across a row the line
+ *  wrapped onto. Only edits in the middle of the line redraw anything, and
+ *  then only the characters from the edit to the end of the line.
+ *
+ *  A line long enough to scroll its start off the top of the screen has a
+ *  negative start. The characters up there can't be shown or pointed at, so
+ *  the cursor stops at the first character still on screen, and nothing
+ *  before it can be deleted.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+
+#include <p1kern.h>     /* putbytes(), set_cursor(), ... */
+#include <stddef.h>     /* NULL */
+#include <stdbool.h>    /* bool */
+#include <string.h>     /* memmove() */
+#include <keyhelp.h>    /* KHE_ARROW_LEFT, KHE_ARROW_RIGHT */
+#include <console.h>    /* console_get_geometry(), console_flush() */
+#include <kb.h>         /* readchar_blocking() */
+
+#include <readline.h>
+
+/* ASCII codes bounding the characters that can be typed into a line */
+#define ASCII_SPACE 0x20
+#define ASCII_DEL   0x7F
+
+/* a line being edited */
+typedef struct {
+    char *buf;      /* characters of the line, no NUL until it is done */
+    int size;       /* most characters buf can hold */
+    int len;        /* number of characters in the line */
+    int pos;        /* index in buf of the character the cursor is on */
+    int start;      /* screen cell the first character of the line is in */
+} line_t;
+
+/** @brief finds the first character of the line that is still on screen
+ *
+ *  @param line line being edited
+ *  @return index of that character
+ */
+static int first_visible(const line_t *line)
+{
+    return line->start < 0 ? -line->start : 0;
+}
+
+/** @brief moves the cursor onto a character of the line
+ *
+ *  @param line line being edited
+ *  @param index index of the character, may be one past the end; characters
+ *         scrolled off the top are clamped to the first one on screen
+ *  @return Void.
+ */
+static void move_to(line_t *line, int index)
+{
+    int width = console_get_geometry()->width;
+    if (index < first_visible(line)) {
+        index = first_visible(line);
+    }
+    int cell = line->start + index;
+    set_cursor(cell / width, cell % width);
+}
+
+/** @brief works out where the line starts from where output left the cursor
+ *
+ *  @param line line being edited
+ *  @param index index of the character the cursor is now on
+ *  @return Void.
+ */
+static void find_start(line_t *line, int index)
+{
+    int row, col;
+    get_cursor(&row, &col);
+    line->start = row * console_get_geometry()->width + col - index;
+}
+
+/** @brief redraws the line from some character to its end
+ *
+ *  Then puts the cursor back onto line->pos.
+ *
+ *  @param line line being edited
+ *  @param from index of the first character to redraw
+ *  @param erase whether the line just got a character shorter, so the cell
+ *         just past its new end has to be blanked too
+ *  @return Void.
+ */
+static void redraw_from(line_t *line, int from, bool erase)
+{
+    move_to(line, from);
+    putbytes(&line->buf[from], line->len - from);
+    find_start(line, line->len);
+    if (erase) {
+        int width = console_get_geometry()->width;
+        int cell = line->start + line->len;
+        int color;
+        get_term_color(&color);
+        /* drawn rather than printed so this can't wrap or scroll */
+        draw_char(cell / width, cell % width, ASCII_SPACE, color);
+    }
+    /* the redraw may have scrolled the cursor's character off the top */
+    if (line->pos < first_visible(line)) {
+        line->pos = first_visible(line);
+    }
+    move_to(line, line->pos);
+}
+
+/** @brief inserts a character at the cursor
+ *
+ *  @param line line being edited
+ *  @param ch character to insert
+ *  @return Void.
+ */
+static void insert_char(line_t *line, char ch)
+{
+    if (line->len == line->size) {
+        return;
+    }
+    memmove(&line->buf[line->pos + 1], &line->buf[line->pos],
+            line->len - line->pos);
+    line->buf[line->pos] = ch;
+    line->len++;
+    line->pos++;
+    if (line->pos == line->len) {
+        putbytes(&ch, 1);
+        find_start(line, line->pos);
+    }
+    else {
+        redraw_from(line, line->pos - 1, false);
+    }
+}
+
+/** @brief deletes the character before the cursor
+ *
+ *  @param line line being edited
+ *  @return Void.
+ */
+static void delete_char(line_t *line)
+{
+    if (line->pos <= first_visible(line)) {
+        return;
+    }
+    memmove(&line->buf[line->pos - 1], &line->buf[line->pos],
+            line->len - line->pos);
+    line->len--;
+    line->pos--;
+    if (line->pos == line->len) {
+        putbytes("\b", 1);
+    }
+    else {
+        redraw_from(line, line->pos, true);
+    }
+}
+
+int readline(char *buf, int len)
+{
+    if (buf == NULL || len <= 0) {
+        return -1;
+    }
+
+    line_t line = { .buf = buf, .size = len - 1, .len = 0, .pos = 0 };
+    find_start(&line, 0);
+
+    while (1) {
+        /* nothing else flushes while we wait, so show the edits so far */
+        console_flush();
+        int ch = readchar_blocking();
+        switch (ch) {
+            case '\n':
+                move_to(&line, line.len);
+                putbytes("\n", 1);
+                console_flush();
+                buf[line.len] = '\0';
+                return line.len;
+            case '\b':
+                delete_char(&line);
+                break;
+            case KHE_ARROW_LEFT:
+                if (line.pos > first_visible(&line)) {
+                    move_to(&line, --line.pos);
+                }
+                break;
+            case KHE_ARROW_RIGHT:
+                if (line.pos < line.len) {
+                    move_to(&line, ++line.pos);
+                }
+                break;
+            default:
+                if (ch >= ASCII_SPACE && ch < ASCII_DEL) {
+                    insert_char(&line, ch);
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+/** @file readline.h
+ *  @brief cooked mode line editor interface
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef __READLINE_H_
+#define __READLINE_H_
+
+/** @brief reads a line of text from the keyboard, echoing and editing it
+ *
+ *  Waits for keypresses until Enter is pressed. Printable characters are
+ *  inserted at the cursor, Backspace deletes the character before it and the
+ *  left/right arrows move it along the line. Only the part of the line from
+ *  the edit onward is redrawn. Once the buffer is full, further characters
+ *  are dropped.
+ *
+ *  @param buf where to store the line, which is NUL terminated and doesn't
+ *         include the '\n'
+ *  @param len size of buf, including room for the NUL
+ *  @return number of characters in the line, or -1 if buf is NULL or len
+ *          isn't positive
+ */
+int readline(char *buf, int len);
+
+#endif /* __READLINE_H_ */
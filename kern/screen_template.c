@@ -0,0 +1,96 @@
+/** @file screen_template.c
+ *  @brief pre-rendered screen implementation
+ *
+ *  The static text of a template is a console snapshot, so laying a screen
+ *  out is done by the same drawing code that would have drawn it anyway, and
+ *  showing it is console_snapshot_restore(), which already only writes the
+ *  cells that differ. Putting back a screen that is still mostly showing
+ *  costs next to nothing.
+ *
+ *  A field is drawn as a single row of cells its full width, so a shorter
+ *  value than last time blanks out what's left of the longer one without the
+ *  caller having to pad it.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug described in screen_template.h
+ */
+#include <stddef.h>     /* NULL */
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint16_t */
+#include <string.h>     /* strlen() */
+#include <console.h>    /* console_clear(), draw_cells(), ... */
+
+#include <screen_template.h>
+
+void template_begin(screen_template_t *tmpl)
+{
+    tmpl->built = false;
+    tmpl->num_fields = 0;
+    console_clear(true);
+}
+
+int template_add_field(screen_template_t *tmpl, int row, int col, int width,
+                       int color, field_align_t align)
+{
+    if (tmpl->num_fields == TEMPLATE_MAX_FIELDS) {
+        return -1;
+    }
+    /* fields off screen still take an index, so callers can count on them */
+    const console_geometry_t *geom = console_get_geometry();
+    if (row < 0 || row >= geom->height || col < 0 || col >= geom->width) {
+        width = 0;
+    }
+    else if (width > geom->width - col) {
+        width = geom->width - col;
+    }
+
+    template_field_t *field = &tmpl->fields[tmpl->num_fields];
+    field->row = row;
+    field->col = col;
+    field->width = (width > 0) ? width : 0;
+    field->color = color;
+    field->align = align;
+    return tmpl->num_fields++;
+}
+
+void template_end(screen_template_t *tmpl)
+{
+    console_snapshot_save(&tmpl->screen);
+    tmpl->built = true;
+}
+
+bool template_show(const screen_template_t *tmpl)
+{
+    if (!tmpl->built) {
+        return false;
+    }
+    return console_snapshot_restore(&tmpl->screen) == 0;
+}
+
+void template_set_field(const screen_template_t *tmpl, int field,
+                        const char *text)
+{
+    if (field < 0 || field >= tmpl->num_fields) {
+        return;
+    }
+    const template_field_t *f = &tmpl->fields[field];
+    if (f->width == 0) {
+        return;
+    }
+    uint16_t blank = CONSOLE_CELL(' ', f->color);
+    uint16_t cells[CONSOLE_MAX_WIDTH];
+
+    int len = (text == NULL) ? 0 : strlen(text);
+    if (len > f->width) {
+        len = f->width;
+    }
+    int start = (f->align == FIELD_CENTER) ? (f->width - len) / 2 : 0;
+    int i;
+    for (i = 0; i < f->width; i++) {
+        cells[i] = blank;
+    }
+    for (i = 0; i < len; i++) {
+        cells[start + i] = CONSOLE_CELL(text[i], f->color);
+    }
+    draw_cells(f->row, f->col, cells, f->width);
+}
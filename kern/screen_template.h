@@ -0,0 +1,105 @@
+/** @file screen_template.h
+ *  @brief pre-rendered screen interface
+ *
+ *  Interface for laying a screen out once and showing it again later without
+ *  working out where anything goes. A template is a copy of the screen's
+ *  static text, taken right after it was first drawn, plus a list of fields:
+ *  boxes on the screen whose text changes from one showing to the next, like
+ *  a score. Showing a template puts the static text back in one go, and then
+ *  only the fields are drawn.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug A template is only good for the text mode it was laid out in, so
+ *       after a mode change template_show() fails and it has to be laid out
+ *       again.
+ */
+#ifndef __SCREEN_TEMPLATE_H_
+#define __SCREEN_TEMPLATE_H_
+
+#include <stdbool.h>    /* bool */
+#include <console.h>    /* console_snapshot_t */
+
+/* most fields one template can have */
+#define TEMPLATE_MAX_FIELDS 8
+
+/* where a field's text goes within the field */
+typedef enum {
+    FIELD_LEFT,
+    FIELD_CENTER,
+} field_align_t;
+
+/* a box on the screen that is redrawn every time the template is shown */
+typedef struct {
+    int row;
+    int col;
+    int width;              /* cells, 0 if the field is off screen */
+    int color;
+    field_align_t align;
+} template_field_t;
+
+/* a screen laid out ahead of time */
+typedef struct {
+    bool built;             /* whether template_end() has been called */
+    console_snapshot_t screen;
+    int num_fields;
+    template_field_t fields[TEMPLATE_MAX_FIELDS];
+} screen_template_t;
+
+/** @brief starts laying out a template
+ *
+ *  Clears the screen output goes to and forgets any fields the template had.
+ *  The static text is then drawn with the usual console functions, and the
+ *  fields are added with template_add_field().
+ *
+ *  @param tmpl template to lay out
+ *  @return Void.
+ */
+void template_begin(screen_template_t *tmpl);
+/** @brief adds a field to a template being laid out
+ *
+ *  Fields are numbered from 0 in the order they're added. A field that is
+ *  off screen still gets its number, but is never drawn.
+ *
+ *  @param tmpl template being laid out
+ *  @param row row of the field
+ *  @param col column the field starts at
+ *  @param width number of cells the field covers, clipped to the screen
+ *  @param color color of the field's text and of the blanks around it
+ *  @param align where in the field its text is drawn
+ *  @return index of the field to pass to template_set_field(), or -1 if the
+ *          template has no room for it
+ */
+int template_add_field(screen_template_t *tmpl, int row, int col, int width,
+                       int color, field_align_t align);
+/** @brief finishes laying out a template, saving what's on screen
+ *
+ *  The screen is left as it is, so the fields can be filled straight away
+ *  just like after template_show().
+ *
+ *  @param tmpl template being laid out
+ *  @return Void.
+ */
+void template_end(screen_template_t *tmpl);
+/** @brief puts a template's static text on the screen output goes to
+ *
+ *  Only cells that differ from what's on screen are written. The fields are
+ *  left showing whatever the template had in them when it was laid out.
+ *
+ *  @param tmpl template to show
+ *  @return true on success, false if the template has to be laid out (again)
+ *          first
+ */
+bool template_show(const screen_template_t *tmpl);
+/** @brief draws a field's text, blanking the rest of the field
+ *
+ *  Text that doesn't fit in the field is cut off.
+ *
+ *  @param tmpl template being shown
+ *  @param field index returned by template_add_field()
+ *  @param text text to draw, NULL for none
+ *  @return Void.
+ */
+void template_set_field(const screen_template_t *tmpl, int field,
+                        const char *text);
+
+#endif /* __SCREEN_TEMPLATE_H_ */
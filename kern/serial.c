@@ -0,0 +1,148 @@
+/** @file serial.c
+ *  @brief COM1 serial port implementation
+ *
+ *  Output is queued in tx_ring and the UART is only ever handed a FIFO's
+ *  worth of it at a time: the first write into an idle UART fills its FIFO,
+ *  and every transmit holding register empty interrupt after that refills it
+ *  from the ring. Once the ring runs dry the UART goes idle again and the
+ *  next write starts it back up. Nothing ever polls the line status, so a
+ *  slow line costs the writer nothing but ring space.
+ *
+ *  tx_head and tx_tail count up forever and are masked to index the ring.
+ *  Both the writer and the interrupt handler touch tx_tail and tx_busy, so
+ *  each keeps interrupts disabled while it does.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug described in serial.h
+ */
+#include <stdbool.h>    /* bool */
+#include <stdint.h>     /* uint8_t, uint32_t */
+#include <asm.h>        /* inb(), outb(), disable_interrupts() */
+#include <eflags.h>     /* get_eflags(), set_eflags() */
+
+#include <serial.h>
+
+/* base I/O port of COM1 and the offsets of its registers from it */
+#define COM1_BASE       0x3F8
+#define UART_DATA       0   /* transmit holding register */
+#define UART_IER        1   /* interrupt enable */
+#define UART_IIR        2   /* interrupt identification, when read */
+#define UART_FCR        2   /* FIFO control, when written */
+#define UART_LCR        3   /* line control */
+#define UART_MCR        4   /* modem control */
+#define UART_SCRATCH    7
+/* with LCR_DLAB set, the first two registers hold the baud rate divisor */
+#define UART_DIVISOR_LO 0
+#define UART_DIVISOR_HI 1
+
+#define IER_NONE        0x00
+#define IER_THRE        0x02    /* interrupt when the FIFO has emptied */
+#define IIR_NO_INT      0x01    /* set when nothing is pending */
+#define IIR_ID_MASK     0x0E
+#define IIR_THRE        0x02
+#define FCR_ENABLE      0xC7    /* enable and clear both FIFOs */
+#define LCR_DLAB        0x80
+#define LCR_8N1         0x03
+/* DTR and RTS, and OUT2, which connects the UART's interrupt to the PIC */
+#define MCR_DTR_RTS_OUT2 0x0B
+/* 115200 baud off the UART's 1.8432MHz clock */
+#define BAUD_DIVISOR    1
+/* value written to the scratch register to see if anything is there */
+#define SCRATCH_PROBE   0xA5
+
+/* bytes the transmit FIFO of a 16550 holds */
+#define UART_FIFO_SIZE  16
+
+#define TX_MASK (SERIAL_TX_SIZE - 1)
+
+static char tx_ring[SERIAL_TX_SIZE];
+static unsigned int tx_head = 0;
+static volatile unsigned int tx_tail = 0;
+/* whether the UART has bytes of ours it hasn't interrupted for yet */
+static volatile bool tx_busy = false;
+static bool initialized = false;
+
+/** @brief hands the UART as much of the ring as its FIFO holds
+ *
+ *  @pre interrupts are disabled, and the UART's FIFO is empty
+ *  @return Void.
+ */
+static void fill_fifo(void)
+{
+    int n = 0;
+    while (n < UART_FIFO_SIZE && tx_tail != tx_head) {
+        outb(COM1_BASE + UART_DATA, tx_ring[tx_tail & TX_MASK]);
+        tx_tail++;
+        n++;
+    }
+    tx_busy = (n > 0);
+}
+
+int serial_init(void)
+{
+    if (initialized) {
+        return 0;
+    }
+    /* reads of a port with nothing behind it float to all ones */
+    outb(COM1_BASE + UART_SCRATCH, SCRATCH_PROBE);
+    if (inb(COM1_BASE + UART_SCRATCH) != SCRATCH_PROBE) {
+        return -1;
+    }
+
+    outb(COM1_BASE + UART_IER, IER_NONE);
+    outb(COM1_BASE + UART_LCR, LCR_DLAB);
+    outb(COM1_BASE + UART_DIVISOR_LO, BAUD_DIVISOR & 0xFF);
+    outb(COM1_BASE + UART_DIVISOR_HI, BAUD_DIVISOR >> 8);
+    outb(COM1_BASE + UART_LCR, LCR_8N1);
+    outb(COM1_BASE + UART_FCR, FCR_ENABLE);
+    outb(COM1_BASE + UART_MCR, MCR_DTR_RTS_OUT2);
+    outb(COM1_BASE + UART_IER, IER_THRE);
+
+    initialized = true;
+    return 0;
+}
+
+void serial_write(const char *s, int len)
+{
+    if (!initialized) {
+        return;
+    }
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    int i;
+    for (i = 0; i < len; i++) {
+        /* room for the byte, and the '\r' in front of it if it's a '\n' */
+        unsigned int need = (s[i] == '\n') ? 2 : 1;
+        if (tx_head - tx_tail + need > SERIAL_TX_SIZE) {
+            break;
+        }
+        if (s[i] == '\n') {
+            tx_ring[tx_head++ & TX_MASK] = '\r';
+        }
+        tx_ring[tx_head++ & TX_MASK] = s[i];
+    }
+    if (!tx_busy) {
+        fill_fifo();
+    }
+
+    set_eflags(eflags);
+}
+
+void serial_interrupt(void)
+{
+    /* our trap gate leaves interrupts on, and the timer may write output */
+    uint32_t eflags = get_eflags();
+    disable_interrupts();
+
+    uint8_t iir;
+    while (!((iir = inb(COM1_BASE + UART_IIR)) & IIR_NO_INT)) {
+        /* reading IIR acknowledged it; nothing else is ever enabled */
+        if ((iir & IIR_ID_MASK) != IIR_THRE) {
+            break;
+        }
+        fill_fifo();
+    }
+
+    set_eflags(eflags);
+}
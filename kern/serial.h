@@ -0,0 +1,53 @@
+/** @file serial.h
+ *  @brief COM1 serial port interface
+ *
+ *  Interface for a transmit-only driver for the 16550 UART at COM1. Bytes are
+ *  queued in a ring and fed into the UART's FIFO by its transmit interrupt,
+ *  so writing never waits on the line. Under QEMU with -serial stdio this is
+ *  a cheap way to get the console's output out of a headless machine.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug Once the ring is full, further bytes are dropped until the UART has
+ *       caught up, so a burst of output bigger than SERIAL_TX_SIZE loses its
+ *       tail.
+ */
+#ifndef __SERIAL_H_
+#define __SERIAL_H_
+
+#include <x86/pic.h>    /* X86_PIC_MASTER_IRQ_BASE */
+
+/* COM1 raises IRQ 4, which the PIC delivers at this IDT entry */
+#define SERIAL_IRQ          4
+#define SERIAL_IDT_ENTRY    (X86_PIC_MASTER_IRQ_BASE + SERIAL_IRQ)
+
+/* bytes of output queued for the UART, a power of two */
+#define SERIAL_TX_SIZE      4096
+
+/** @brief sets COM1 up for 115200 8N1 with its transmit interrupt enabled
+ *
+ *  Only does anything the first time it's called.
+ *
+ *  @pre the serial handler is registered for SERIAL_IRQ before interrupts
+ *       are next enabled
+ *  @return 0 on success, negative if there's no UART at COM1
+ */
+int serial_init(void);
+/** @brief queues bytes to be sent out of COM1
+ *
+ *  '\n' goes out as "\r\n", since whatever is on the other end is a terminal.
+ *  Bytes that don't fit in the ring are dropped. Safe to call with interrupts
+ *  enabled or disabled.
+ *
+ *  @param s bytes to send
+ *  @param len number of bytes
+ *  @return Void.
+ */
+void serial_write(const char *s, int len);
+/** @brief services a COM1 interrupt by refilling the UART's transmit FIFO
+ *
+ *  @pre called from the IRQ 4 handler, which acknowledges the PIC afterwards
+ *  @return Void.
+ */
+void serial_interrupt(void);
+
+#endif /* __SERIAL_H_ */
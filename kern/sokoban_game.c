@@ -11,10 +11,15 @@
 #include <p1kern.h>
 #include <sokoban.h>
 #include <stdbool.h>        /* bool */
-#include <stdint.h>         /* UINT32_MAX */
+#include <stdint.h>         /* UINT32_MAX, uint16_t */
 #include <video_defines.h>  /* console size, color constants */
 #include <stdio.h>          /* printf() */
-#include <string.h>         /* memcpy() */
+#include <string.h>         /* strlen() */
+#include <console.h>        /* console_switch(), draw_cells(), blit_sprite() */
+#include <gfx.h>            /* gfx_enter(), gfx_put_sprite(), gfx_flush() */
+#include <screen_template.h> /* template_show(), template_set_field() */
+#include <compositor.h>     /* compositor_register(), compositor_submit() */
+#include <kb.h>             /* read_key_events(), wait_for_input() */
 
 /* scoring system is just moves/time, so default score is just the max val */
 #define DEFAULT_SCORE       UINT32_MAX
@@ -29,6 +34,15 @@
 #define MY_SOK_GOAL         ('x')
 /* Distinguish between boxes on goal and boxes not on goal in game logic */
 #define MY_SOK_BOX_ON_GOAL  ('O')
+/**
+ *  The game is drawn on one virtual console and the instructions screen on
+ *  another, so going back to the game is just switching consoles
+ */
+#define GAME_CONSOLE        0
+#define MENU_CONSOLE        1
+
+/* level map cell that isn't drawn; no symbol is ever NUL on black */
+#define TRANSPARENT_CELL    0
 
 /* Lakers colors bc rip kobe :'( */
 #define MAIN_COLOR          (FGND_YLLW | BGND_BLACK)
@@ -83,8 +97,36 @@
  */
 #define FORMAT_STR_OFFSET   3
 
-/* Size of the console screen in bytes */
-#define CONSOLE_SIZE        (2 * CONSOLE_HEIGHT * CONSOLE_WIDTH)
+/* room for a full row of text plus the escape sequences around it */
+#define PUTSTRING_BUF_SIZE  (2 * CONSOLE_MAX_WIDTH)
+/* room for any number of ticks formatted as seconds, with snprintf()'s '\0' */
+#define TIME_BUF_SIZE       16
+
+/* key events the main loop reads off the queue at a time */
+#define KEY_EVENT_BATCH     16
+
+/* cells set aside for a number of moves or a time on the menu screens */
+#define SCORE_FIELD_WIDTH   10
+/* fields of the introduction template, in the order they're added */
+#define INTRO_MOVES_FIELD(i)    (2 * (i))
+#define INTRO_TIME_FIELD(i)     (2 * (i) + 1)
+/* fields of the level summary templates, in the order they're added */
+#define SUMMARY_MESSAGE_FIELD   0
+#define SUMMARY_MOVES_FIELD     1
+#define SUMMARY_TIME_FIELD      2
+
+/* size of the screen, which depends on the text mode picked at boot */
+#define SCREEN_WIDTH    (console_get_geometry()->width)
+#define SCREEN_HEIGHT   (console_get_geometry()->height)
+
+/* tile rows the level, moves and time go on when drawing with tiles */
+#define TILE_LEVEL_ROW      0
+#define TILE_MOVES_ROW      1
+#define TILE_TIME_ROW       2
+#define TILE_INFO_COL       1
+/* first tile row the board may use, and the row messages go on below it */
+#define TILE_BOARD_TOP      4
+#define TILE_MESSAGE_ROW    (GFX_ROWS - 1)
 
 /** @brief used to align an image vertically
  *
@@ -140,13 +182,15 @@ static void draw_image(const char *image, int start_row, int start_col,
                        int height, int width, int color);
 /** @brief draws the specified level and checks if it's valid
  *
- *  Centers the map of the level and iterates through the string, printing
- *  symbols accordingly. While iterating through, we also check to make sure the
- *  map is valid, return true if it is and false otherwise. We also draw the
- *  level number/num moves/time information.
+ *  Centers the map of the level and iterates through the string, turning
+ *  symbols into cells accordingly, then blits the whole map at once. While
+ *  iterating through, we also check to make sure the map is valid, return true
+ *  if it is and false otherwise. We also draw the level number/num moves/time
+ *  information.
  *
  *  Things that are invalid:
  *  Any NULL parameters
+ *  Map bigger than the console
  *  Zero boxes found
  *  No player character found
  *  Multiple player characters found
@@ -173,6 +217,13 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
  *  @return Void.
  */
 static void put_time_at_loc(int ticks, int row, int col);
+/** @brief formats a number of ticks as seconds to 0.1 second precision
+ *
+ *  @param buf buffer of TIME_BUF_SIZE characters to format into
+ *  @param ticks number of ticks to format
+ *  @return number of characters in the formatted time
+ */
+static int format_time(char *buf, int ticks);
 /** @brief prints the number of moves in current level
  *
  *  Prints the current number of moves in the level at the fixed moves location
@@ -185,20 +236,26 @@ static void print_current_game_moves(void);
 /** @brief prints time elapsed in current level
  *
  *  Prints the amount of time that has elapsed while the current level running
- *  has not been paused. Called as we start/restart a level as well as during
- *  the tickback function.
+ *  has not been paused. Called as we start/restart a level.
  *
  *  @return Void.
  */
 static void print_current_game_time(void);
+/** @brief posts time elapsed in current level to be drawn by the main loop
+ *
+ *  What the tickback function uses instead of print_current_game_time(), so
+ *  that the timer interrupt never touches the cursor or color the main loop
+ *  may be in the middle of using.
+ *
+ *  @return Void.
+ */
+static void post_current_game_time(void);
 /** @brief prints a string at a given row/col with a given color
  *
- *  One pass method to printing a string that we don't know the length of as
- *  well as in a different color from the console wide one. Not super necessary
- *  since printing unknown strings is potentially unsafe and printing known
- *  const char* strings, we can just use putbytes() since strlen() optimizes
- *  down to a constant. However, it wraps up the logic to printing at a specific
- *  position/color nicely.
+ *  Formats escape sequences to move the cursor and switch to the color, the
+ *  string itself, and a sequence switching back to the console wide color
+ *  into one buffer, then hands the whole thing to a single putbytes() call.
+ *  Strings longer than a row get cut short.
  *
  *  @param str string to print
  *  @param row row to start printing at
@@ -280,7 +337,8 @@ static void level_up(void);
  *
  *  Displays end level message, moves, time, and changes game state so
  *  handle_input() knows to expect any key. If we've completed the last level,
- *  update the highscores accordingly as well.
+ *  update the highscores accordingly as well. The last level has its own
+ *  template, since its labels say "Total".
  *
  *  @return Void.
  */
@@ -296,7 +354,8 @@ static void quit_game(void);
 /** @brief pauses the actively running game
  *
  *  Can only be called if the current level is running. Changes game state,
- *  clears console, and displays the paused message.
+ *  saves a snapshot of the game screen and draws the paused message across
+ *  it, which unpausing undoes by restoring the snapshot.
  *
  *  @return Void.
  */
@@ -337,19 +396,64 @@ static void start_sokoban_level(int level_number);
 static void start_game(void);
 /** @brief displays instructions screen
  *
- *  Loops through instructions string array and displays them one by one.
+ *  Nothing on it ever changes, so after the first time this just puts the
+ *  template back, which writes nothing if the menu console still shows it.
  *
  *  @return Void.
  */
 static void display_instructions(void);
 /** @brief displays introduction screen
  *
- *  Changes state then does a lot of weird alignment to draw my beautiful ASCII
- *  arts as well as the highscores. Don't print default highscores.
+ *  Changes state then puts back the introduction template, laying it out
+ *  first if need be, and fills in the highscores. Don't print default
+ *  highscores.
  *
  *  @return Void.
  */
 static void display_introduction(void);
+/** @brief lays out the level summary screen into a template
+ *
+ *  The level's message, the moves and the time are left as fields, since
+ *  they change every time the screen is shown.
+ *
+ *  @param tmpl template to lay the screen out in
+ *  @param end_level_msg message telling the player what to press next
+ *  @param moves_str label in front of the number of moves
+ *  @param time_str label in front of the time
+ *  @return Void.
+ */
+static void layout_summary(screen_template_t *tmpl, const char *end_level_msg,
+                           const char *moves_str, const char *time_str);
+/** @brief lays out the instructions screen into instructions_template
+ *
+ *  @pre output goes to the menu console
+ *  @return Void.
+ */
+static void layout_instructions(void);
+/** @brief lays out the introduction screen into intro_template
+ *
+ *  The highscores are left as fields, since they change as games are won.
+ *
+ *  @return Void.
+ */
+static void layout_introduction(void);
+/** @brief switches to drawing the board with tiles, if that's turned on
+ *
+ *  Only if the level fits in the tile grid; otherwise the board stays text.
+ *
+ *  @return Void.
+ */
+static void show_tiles(void);
+/** @brief redraws every tile whose square of the game console changed
+ *
+ *  The game keeps drawing the board as text, which is also what try_move()
+ *  reads back, so the tiles just mirror the console's cells: sprites for the
+ *  board and text for the level, moves and time. Only tiles that changed
+ *  get copied out to VGA memory. Does nothing unless tiles are showing.
+ *
+ *  @return Void.
+ */
+static void present_tiles(void);
 
 /* ASCII art used in my introduction screen */
 const char *ascii_sokoban = "\
@@ -407,10 +511,18 @@ const char *instructions[] = {
     0,
 };
 
-/* state of the screen before we pause/instructions for easy recovery */
-char saved_screen[CONSOLE_SIZE];
-/* intermediate buffer to create our 0.1 second precision timing */
-char timer_print_buf[CONSOLE_WIDTH];
+/* map of the level being drawn, built up before being blitted in one go */
+uint16_t level_cells[CONSOLE_MAX_CELLS];
+/* game screen from before the pause message was drawn over it */
+console_snapshot_t pause_snapshot;
+/* the menu screens, each laid out the first time it's shown */
+screen_template_t intro_template;
+screen_template_t instructions_template;
+screen_template_t summary_template;
+screen_template_t game_complete_template;
+
+/* whether sokoban_use_tiles() was called */
+static bool use_tiles = false;
 
 /* state of the currently running sokoban game; not looked at if not running */
 game_t current_game;
@@ -419,20 +531,20 @@ sokoban_t sokoban;
 
 static inline int align_row(alignment_t alignment, int height, int percentage)
 {
-    if (height < 0 || height >= CONSOLE_HEIGHT ||
+    if (height < 0 || height >= SCREEN_HEIGHT ||
         percentage < 0 || percentage > MAX_PERCENT) {
         return -1;
     }
 
     switch (alignment) {
         case TOP_SIDE:
-            return (CONSOLE_HEIGHT * percentage / MAX_PERCENT);
+            return (SCREEN_HEIGHT * percentage / MAX_PERCENT);
         case CENTER:
-            return ((CONSOLE_HEIGHT - height) * percentage) / MAX_PERCENT;
+            return ((SCREEN_HEIGHT - height) * percentage) / MAX_PERCENT;
         // this can return negative
         case BOTTOM_SIDE:
-            return (CONSOLE_HEIGHT -
-                    (CONSOLE_HEIGHT * percentage) / MAX_PERCENT -
+            return (SCREEN_HEIGHT -
+                    (SCREEN_HEIGHT * percentage) / MAX_PERCENT -
                     height);
         default:
             return -1;
@@ -441,20 +553,20 @@ static inline int align_row(alignment_t alignment, int height, int percentage)
 
 static inline int align_col(alignment_t alignment, int width, int percentage)
 {
-    if (width < 0 || width >= CONSOLE_WIDTH ||
+    if (width < 0 || width >= SCREEN_WIDTH ||
         percentage < 0 || percentage > MAX_PERCENT) {
         return -1;
     }
 
     switch (alignment) {
         case LEFT_SIDE:
-            return (CONSOLE_WIDTH * percentage / MAX_PERCENT);
+            return (SCREEN_WIDTH * percentage / MAX_PERCENT);
         case CENTER:
-            return ((CONSOLE_WIDTH - width) * percentage) / MAX_PERCENT;
+            return ((SCREEN_WIDTH - width) * percentage) / MAX_PERCENT;
         case RIGHT_SIDE:
             // this can return negative
-            return (CONSOLE_WIDTH -
-                    (CONSOLE_WIDTH * percentage / MAX_PERCENT) -
+            return (SCREEN_WIDTH -
+                    (SCREEN_WIDTH * percentage / MAX_PERCENT) -
                     width);
         default:
             return -1;
@@ -471,7 +583,7 @@ void sokoban_tickback()
     }
 
     if (++current_game.level_ticks % 10 == 0) {
-        print_current_game_time();
+        post_current_game_time();
     } 
 }
 
@@ -482,15 +594,19 @@ static void draw_image(const char *image, int start_row, int start_col,
         return;
     }
 
+    if (width > SCREEN_WIDTH) {
+        width = SCREEN_WIDTH;
+    }
+
+    /* build one row of cells at a time and draw it in one go */
+    uint16_t cells[CONSOLE_MAX_WIDTH];
     int i, j;
-    int end_row = start_row + height;
-    int end_col = start_col + width;
-    int pixel_count = 0;
-    for (i = start_row; i < end_row; i++) {
-        for (j = start_col; j < end_col; j++) {
-            draw_char(i, j, image[pixel_count], color);
-            pixel_count++;
+    for (i = 0; i < height; i++) {
+        for (j = 0; j < width; j++) {
+            cells[j] = CONSOLE_CELL(image[j], color);
         }
+        draw_cells(start_row + i, start_col, cells, width);
+        image += width;
     }
 }
 
@@ -501,14 +617,19 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
         start_row == NULL || start_col == NULL) {
         return false;
     }
+    /* align_row() and align_col() only place levels smaller than the screen */
+    if (level->height >= SCREEN_HEIGHT || level->width >= SCREEN_WIDTH) {
+        return false;
+    }
 
-    clear_console();
+    console_clear(true);
 
     set_cursor(LEVEL_INFO_ROW, SIDE_INFO_COL);
     printf("Level: %d", current_game.level_number);
 
-    int curr_row = align_row(CENTER, level->height, ALIGNMENT_HALF);
+    int first_row = align_row(CENTER, level->height, ALIGNMENT_HALF);
     int first_col = align_col(CENTER, level->width, ALIGNMENT_HALF);
+    int curr_row = first_row;
     int curr_col = first_col;
     int end_col = curr_col + level->width - 1;
 
@@ -548,7 +669,8 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
                 ch = MY_SOK_GOAL;
                 break;
             default:
-                /* space character */
+                /* space character, leave whatever is on screen */
+                level_cells[pixel_count] = TRANSPARENT_CELL;
                 if (curr_col == end_col) {
                     curr_col = first_col;
                     curr_row++;
@@ -559,7 +681,7 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
                 continue;
         }
 
-        draw_char(curr_row, curr_col, ch, color);
+        level_cells[pixel_count] = CONSOLE_CELL(ch, color);
         if (curr_col == end_col) {
             /* wrap back around */
             curr_col = first_col;
@@ -575,6 +697,11 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
         return false;
     }
 
+    blit_sprite(first_row, first_col, level_cells,
+                level->height, level->width, TRANSPARENT_CELL);
+    current_game.board_row = first_row;
+    current_game.board_col = first_col;
+
     *total_boxes = num_boxes;
 
     /* print game information */
@@ -590,15 +717,23 @@ static bool draw_sokoban_level(sokolevel_t *level, int *total_boxes,
     return true;
 }
 
-static void put_time_at_loc(int ticks, int row, int col)
+static int format_time(char *buf, int ticks)
 {
     /* uses return value of snprintf to know where to draw decimal point */
-    int len = snprintf(timer_print_buf, CONSOLE_WIDTH, "%d", ticks / 10);
-    timer_print_buf[len + 1] = '\0';
-    timer_print_buf[len] = timer_print_buf[len - 1];
-    timer_print_buf[len - 1] = '.';
+    int len = snprintf(buf, TIME_BUF_SIZE - 2, "%d", ticks / 10);
+    buf[len + 1] = '\0';
+    buf[len] = buf[len - 1];
+    buf[len - 1] = '.';
+    return len + 1;
+}
+
+static void put_time_at_loc(int ticks, int row, int col)
+{
+    /* on the stack, since the timer tick formats times too */
+    char buf[TIME_BUF_SIZE];
+    format_time(buf, ticks);
     /* display string once it has been formed */
-    putstring(timer_print_buf, row, col, DEFAULT_COLOR);
+    putstring(buf, row, col, DEFAULT_COLOR);
 }
 
 static void print_current_game_moves()
@@ -614,6 +749,16 @@ static void print_current_game_time()
                     TIME_INFO_ROW, SIDE_INFO_COL + strlen("Time: "));
 }
 
+static void post_current_game_time()
+{
+    char buf[TIME_BUF_SIZE];
+    int len = format_time(buf, current_game.level_ticks);
+    /* if the ring is full, the next update 0.1 seconds later will do */
+    console_post_text(GAME_CONSOLE, TIME_INFO_ROW,
+                      SIDE_INFO_COL + strlen("Time: "), DEFAULT_COLOR,
+                      buf, len);
+}
+
 static void putstring(const char *str, int row, int col, int color)
 {
     if (str == NULL) {
@@ -623,15 +768,14 @@ static void putstring(const char *str, int row, int col, int color)
     int old_color;
     get_term_color(&old_color);
 
-    set_term_color(color);
-    set_cursor(row, col);
-
-    while (*str != '\0') {
-        putbyte(*str);
-        str++;
-    }
-
-    set_term_color(old_color);
+    /* on the stack since the timer tick prints with this too */
+    char buf[PUTSTRING_BUF_SIZE];
+    /* snprintf() writes its '\0' past size, so leave room for it */
+    int len = snprintf(buf, sizeof(buf) - 1,
+                       "\033[%d;%dH" CONSOLE_SGR_FMT "%.*s" CONSOLE_SGR_FMT,
+                       row + 1, col + 1, CONSOLE_SGR_ARGS(color),
+                       SCREEN_WIDTH, str, CONSOLE_SGR_ARGS(old_color));
+    putbytes(buf, len);
 }
 
 static bool valid_next_square(dir_t dir, int row, int col,
@@ -650,7 +794,7 @@ static bool valid_next_square(dir_t dir, int row, int col,
             *new_col = col;
             break;
         case DOWN:
-            if (row + 1 >= CONSOLE_HEIGHT) {
+            if (row + 1 >= SCREEN_HEIGHT) {
                 return false;
             }
             *new_row = row + 1;
@@ -664,7 +808,7 @@ static bool valid_next_square(dir_t dir, int row, int col,
             *new_col = col - 1;
             break;
         case RIGHT:
-            if (col + 1 >= CONSOLE_WIDTH - 1) {
+            if (col + 1 >= SCREEN_WIDTH - 1) {
                 return false;
             }
             *new_row = row;
@@ -791,10 +935,11 @@ static void handle_input(char ch)
                     display_introduction();
                 }
                 else if (sokoban.previous_state == GAME_RUNNING) {
-                    memcpy((void*)CONSOLE_MEM_BASE,
-                           (void*)saved_screen, CONSOLE_SIZE);
                     sokoban.state = GAME_RUNNING;
                     current_game.game_state = RUNNING;
+                    /* first, so the text game screen never flashes up */
+                    show_tiles();
+                    console_switch(GAME_CONSOLE);
                 }
                 break;
             default:
@@ -809,21 +954,17 @@ static void handle_input(char ch)
         }
         else if (game_state == PAUSED) {
             if (ch == 'p') {
-                memcpy((void*)CONSOLE_MEM_BASE,
-                       (void*)saved_screen, CONSOLE_SIZE);
+                /* only the row the message is on differs, so that's redrawn */
+                console_snapshot_restore(&pause_snapshot);
                 current_game.game_state = RUNNING;
             }
         }
         else if (game_state == RUNNING) {
             switch (ch) {
                 case 'i':
-                    memcpy((void*)saved_screen,
-                           (void*)CONSOLE_MEM_BASE, CONSOLE_SIZE);
                     display_instructions();
                     break;
                 case 'p':
-                    memcpy((void*)saved_screen,
-                           (void*)CONSOLE_MEM_BASE, CONSOLE_SIZE);
                     pause_game();
                     break;
                 case 'q':
@@ -873,24 +1014,11 @@ static void complete_level()
     current_game.total_ticks += current_game.level_ticks;
     current_game.total_moves += current_game.level_moves;
 
-    clear_console();
-    const char *msg = end_level_messages[current_game.level_number - 1];
-
-    const char *end_level_msg = summary_screen_message;
-    const char *moves_fmt = "Moves: %d";
-    const char *time_fmt = "Time: ";
+    screen_template_t *tmpl = &summary_template;
     int moves = current_game.level_moves;
     unsigned int ticks = current_game.level_ticks;
 
-    /* love me my alignment */
-    int forty_percent = 4 * ALIGNMENT_TENTH;
-
-    putstring(msg,
-              align_row(TOP_SIDE, STRING_HEIGHT, forty_percent),
-              align_col(CENTER, strlen(msg), ALIGNMENT_HALF),
-              MAIN_COLOR);
-
-    /* save highscores and change string to display total moves/ticks */
+    /* save highscores and show total moves/ticks */
     if (current_game.level_number == soko_nlevels) {
         score_t score = { current_game.total_moves, current_game.total_ticks };
 
@@ -907,28 +1035,30 @@ static void complete_level()
                 break;
             }
         }
-        end_level_msg = game_complete_message;
-        moves_fmt = "Total moves: %d";
-        time_fmt = "Total time: ";
+        tmpl = &game_complete_template;
         moves = current_game.total_moves;
         ticks = current_game.total_ticks;
     }
 
-    /* display message and moves/time information */
-    putstring(end_level_msg,
-              align_row(BOTTOM_SIDE, STRING_HEIGHT, ALIGNMENT_QUARTER),
-              align_col(CENTER, strlen(end_level_msg), ALIGNMENT_HALF),
-              ACCENT_COLOR);
-    int moves_row = align_row(BOTTOM_SIDE, STRING_HEIGHT, ALIGNMENT_HALF);
-    int moves_col = align_col(CENTER, strlen(moves_fmt), ALIGNMENT_HALF);
-    int time_row = moves_row + ELEMENT_ROW_SPACING;
-    int time_col = align_col(CENTER, strlen(time_fmt) + FORMAT_STR_OFFSET,
-                             ALIGNMENT_HALF);
-    int time_tick_col = time_col + strlen(time_fmt);
-    set_cursor(moves_row, moves_col);
-    printf(moves_fmt, moves);
-    putstring(time_fmt, time_row, time_col, DEFAULT_COLOR);
-    put_time_at_loc(ticks, time_row, time_tick_col);
+    if (!template_show(tmpl)) {
+        if (tmpl == &game_complete_template) {
+            layout_summary(tmpl, game_complete_message,
+                           "Total moves: ", "Total time: ");
+        }
+        else {
+            layout_summary(tmpl, summary_screen_message,
+                           "Moves: ", "Time: ");
+        }
+    }
+
+    char buf[TIME_BUF_SIZE];
+    template_set_field(tmpl, SUMMARY_MESSAGE_FIELD,
+                       end_level_messages[current_game.level_number - 1]);
+    snprintf(buf, sizeof(buf) - 1, "%d", moves);
+    template_set_field(tmpl, SUMMARY_MOVES_FIELD, buf);
+    format_time(buf, ticks);
+    template_set_field(tmpl, SUMMARY_TIME_FIELD, buf);
+    gfx_leave();
 }
 
 static void quit_game()
@@ -939,9 +1069,11 @@ static void quit_game()
 static void pause_game()
 {
     current_game.game_state = PAUSED;
-    clear_console();
-    putstring(pause_screen_message,
-              align_row(TOP_SIDE, STRING_HEIGHT, ALIGNMENT_HALF),
+    console_snapshot_save(&pause_snapshot);
+    int row = align_row(TOP_SIDE, STRING_HEIGHT, ALIGNMENT_HALF);
+    fill_rect(row, 0, STRING_HEIGHT, SCREEN_WIDTH,
+              CONSOLE_CELL(' ', DEFAULT_COLOR));
+    putstring(pause_screen_message, row,
               align_col(CENTER, strlen(pause_screen_message), ALIGNMENT_HALF),
               DEFAULT_COLOR);
 }
@@ -964,6 +1096,7 @@ static void restart_current_level()
     current_game.boxes_left = total_boxes;
 
     current_game.game_state = RUNNING;
+    show_tiles();
 }
 
 static void start_sokoban_level(int level_number)
@@ -990,7 +1123,82 @@ static void display_instructions()
 {
     sokoban.previous_state = sokoban.state;
     sokoban.state = INSTRUCTIONS;
-    clear_console();
+    console_set_output(MENU_CONSOLE);
+    if (!template_show(&instructions_template)) {
+        layout_instructions();
+    }
+    console_set_output(GAME_CONSOLE);
+    console_switch(MENU_CONSOLE);
+    /* last, so the menu console is what text mode comes back showing */
+    gfx_leave();
+}
+
+static void display_introduction()
+{
+    sokoban.state = INTRODUCTION;
+    if (!template_show(&intro_template)) {
+        layout_introduction();
+    }
+
+    char buf[TIME_BUF_SIZE];
+    int i;
+    for (i = 0; i < NUM_HIGHSCORES; i++) {
+        /* only show moves/time if it's not default */
+        buf[0] = '\0';
+        if (sokoban.highscores[i].num_moves != DEFAULT_SCORE) {
+            snprintf(buf, sizeof(buf) - 1, "%u",
+                     sokoban.highscores[i].num_moves);
+        }
+        template_set_field(&intro_template, INTRO_MOVES_FIELD(i), buf);
+        buf[0] = '\0';
+        if (sokoban.highscores[i].num_ticks != DEFAULT_SCORE) {
+            format_time(buf, sokoban.highscores[i].num_ticks);
+        }
+        template_set_field(&intro_template, INTRO_TIME_FIELD(i), buf);
+    }
+    console_switch(GAME_CONSOLE);
+    gfx_leave();
+}
+
+static void layout_summary(screen_template_t *tmpl, const char *end_level_msg,
+                           const char *moves_str, const char *time_str)
+{
+    template_begin(tmpl);
+
+    /* love me my alignment */
+    int forty_percent = 4 * ALIGNMENT_TENTH;
+
+    /* SUMMARY_MESSAGE_FIELD: the level's message, centered on its row */
+    template_add_field(tmpl,
+                       align_row(TOP_SIDE, STRING_HEIGHT, forty_percent),
+                       0, SCREEN_WIDTH, MAIN_COLOR, FIELD_CENTER);
+
+    /* display message and moves/time labels */
+    putstring(end_level_msg,
+              align_row(BOTTOM_SIDE, STRING_HEIGHT, ALIGNMENT_QUARTER),
+              align_col(CENTER, strlen(end_level_msg), ALIGNMENT_HALF),
+              ACCENT_COLOR);
+    int moves_row = align_row(BOTTOM_SIDE, STRING_HEIGHT, ALIGNMENT_HALF);
+    /* centered as if the moves were a couple of digits long */
+    int moves_col = align_col(CENTER, strlen(moves_str) + 2, ALIGNMENT_HALF);
+    int time_row = moves_row + ELEMENT_ROW_SPACING;
+    int time_col = align_col(CENTER, strlen(time_str) + FORMAT_STR_OFFSET,
+                             ALIGNMENT_HALF);
+    int time_tick_col = time_col + strlen(time_str);
+    putstring(moves_str, moves_row, moves_col, DEFAULT_COLOR);
+    /* SUMMARY_MOVES_FIELD and SUMMARY_TIME_FIELD */
+    template_add_field(tmpl, moves_row, moves_col + strlen(moves_str),
+                       SCORE_FIELD_WIDTH, DEFAULT_COLOR, FIELD_LEFT);
+    putstring(time_str, time_row, time_col, DEFAULT_COLOR);
+    template_add_field(tmpl, time_row, time_tick_col,
+                       SCORE_FIELD_WIDTH, DEFAULT_COLOR, FIELD_LEFT);
+
+    template_end(tmpl);
+}
+
+static void layout_instructions()
+{
+    template_begin(&instructions_template);
     const char *ins_str = "Instructions";
     const char *ret_str = "Press 'i' to return";
     putstring(ins_str,
@@ -1011,12 +1219,12 @@ static void display_instructions()
         i++;
         row += (STRING_HEIGHT + ELEMENT_ROW_SPACING);
     }
+    template_end(&instructions_template);
 }
 
-static void display_introduction()
+static void layout_introduction()
 {
-    sokoban.state = INTRODUCTION;
-    clear_console();
+    template_begin(&intro_template);
 
     int curr_draw_row;
     int curr_draw_col;
@@ -1068,20 +1276,127 @@ static void display_introduction()
 
     int i;
     for (i = 0; i < NUM_HIGHSCORES; i++) {
-        set_cursor(curr_draw_row, curr_draw_col);
-        printf(moves_fmt, i + 1);
-        /* only print moves/time if it's not default */
-        if (sokoban.highscores[i].num_moves != DEFAULT_SCORE) {
-            printf("%u", sokoban.highscores[i].num_moves);
-        }
+        char label[PUTSTRING_BUF_SIZE];
+        int len = snprintf(label, sizeof(label) - 1, moves_fmt, i + 1);
+        putstring(label, curr_draw_row, curr_draw_col, DEFAULT_COLOR);
+        /* adds INTRO_MOVES_FIELD(i) */
+        template_add_field(&intro_template, curr_draw_row,
+                           curr_draw_col + len, SCORE_FIELD_WIDTH,
+                           DEFAULT_COLOR, FIELD_LEFT);
         curr_draw_row += ELEMENT_ROW_SPACING;
         putstring(time_str, curr_draw_row, curr_draw_col, DEFAULT_COLOR);
-        if (sokoban.highscores[i].num_ticks != DEFAULT_SCORE) {
-            put_time_at_loc(sokoban.highscores[i].num_ticks,
-                            curr_draw_row, time_draw_col);
-        }
+        /* adds INTRO_TIME_FIELD(i) */
+        template_add_field(&intro_template, curr_draw_row,
+                           time_draw_col, SCORE_FIELD_WIDTH,
+                           DEFAULT_COLOR, FIELD_LEFT);
         curr_draw_row += ELEMENT_ROW_SPACING;
     }
+    template_end(&intro_template);
+}
+
+static void show_tiles()
+{
+    if (!use_tiles) {
+        return;
+    }
+    sokolevel_t *level = current_game.level;
+    if (level->height > TILE_MESSAGE_ROW - TILE_BOARD_TOP ||
+        level->width > GFX_COLS) {
+        gfx_leave();
+        return;
+    }
+    gfx_enter();
+    present_tiles();
+}
+
+/** @brief mirrors part of a row of the game console onto a row of tiles
+ *
+ *  @param tile_row row of tiles to draw
+ *  @param row row of the console to mirror
+ *  @param col column of the console to start mirroring from
+ *  @return Void.
+ */
+static void present_text_row(int tile_row, int row, int col)
+{
+    int i;
+    for (i = TILE_INFO_COL; i < GFX_COLS; i++) {
+        /* past the right edge this is 0, which draws as a blank */
+        gfx_put_cell(tile_row, i, get_cell(row, col + i - TILE_INFO_COL));
+    }
+}
+
+/** @brief draws a message centered on the bottom row of tiles
+ *
+ *  @param msg message to draw, empty to blank the row
+ *  @return Void.
+ */
+static void present_message(const char *msg)
+{
+    int len = strlen(msg);
+    int first = (GFX_COLS - len) / 2;
+    int i;
+    for (i = 0; i < GFX_COLS; i++) {
+        char ch = (i >= first && i < first + len) ? msg[i - first] : ' ';
+        gfx_put_cell(TILE_MESSAGE_ROW, i, CONSOLE_CELL(ch, DEFAULT_COLOR));
+    }
+}
+
+static void present_tiles()
+{
+    if (!gfx_active()) {
+        return;
+    }
+
+    present_text_row(TILE_LEVEL_ROW, LEVEL_INFO_ROW, SIDE_INFO_COL);
+    present_text_row(TILE_MOVES_ROW, MOVES_INFO_ROW, SIDE_INFO_COL);
+    present_text_row(TILE_TIME_ROW, TIME_INFO_ROW, SIDE_INFO_COL);
+
+    /* the pause message is drawn over the text board, so leave that be */
+    if (current_game.game_state == PAUSED) {
+        present_message(pause_screen_message);
+        gfx_flush();
+        return;
+    }
+    present_message("");
+
+    sokolevel_t *level = current_game.level;
+    int top = TILE_BOARD_TOP +
+              (TILE_MESSAGE_ROW - TILE_BOARD_TOP - level->height) / 2;
+    int left = (GFX_COLS - level->width) / 2;
+    int row, col;
+    for (row = 0; row < level->height; row++) {
+        for (col = 0; col < level->width; col++) {
+            gfx_sprite_t sprite;
+            switch (get_char(current_game.board_row + row,
+                             current_game.board_col + col)) {
+                case MY_SOK_WALL:
+                    sprite = GFX_SPRITE_WALL;
+                    break;
+                case MY_SOK_PLAYER:
+                    sprite = GFX_SPRITE_PLAYER;
+                    break;
+                case MY_SOK_BOX:
+                    sprite = GFX_SPRITE_BOX;
+                    break;
+                case MY_SOK_GOAL:
+                    sprite = GFX_SPRITE_GOAL;
+                    break;
+                case MY_SOK_BOX_ON_GOAL:
+                    sprite = GFX_SPRITE_BOX_ON_GOAL;
+                    break;
+                default:
+                    sprite = GFX_SPRITE_FLOOR;
+                    break;
+            }
+            gfx_put_sprite(top + row, left + col, sprite);
+        }
+    }
+    gfx_flush();
+}
+
+void sokoban_use_tiles()
+{
+    use_tiles = true;
 }
 
 void sokoban_initialize_and_run()
@@ -1096,14 +1411,37 @@ void sokoban_initialize_and_run()
     sokoban.state = INTRODUCTION;
     sokoban.previous_state = INTRODUCTION;
 
+    /* the menu console never needs a cursor either */
+    console_set_output(MENU_CONSOLE);
+    hide_cursor();
+    console_set_output(GAME_CONSOLE);
+
     display_introduction();
 
+    /* the tiles are redrawn at most once a frame, however much changed */
+    int tiles_source = compositor_register(present_tiles);
+
     /* poll for and handle inputs as we receive them */
-    int ch;
+    key_event_t events[KEY_EVENT_BATCH];
     while (1) {
+        /* draw whatever the timer tick posted while we were waiting */
+        if (console_drain_posted() > 0) {
+            compositor_submit(tiles_source);
+        }
+        /* every key that came in since the last frame goes into the next */
+        int n;
         do {
-            ch = readchar();
-        } while (ch == -1);
-        handle_input(ch);
+            n = read_key_events(events, KEY_EVENT_BATCH);
+            int i;
+            for (i = 0; i < n; i++) {
+                if (events[i].make) {
+                    handle_input(KH_GETCHAR(events[i].key));
+                    compositor_submit(tiles_source);
+                }
+            }
+        } while (n == KEY_EVENT_BATCH);
+        compositor_present();
+        /* sleep until a key or the next tick, which may start a frame */
+        wait_for_input(1);
     }
 }
@@ -62,6 +62,8 @@ typedef struct {
 
     int curr_row;               /* what row our player is at */
     int curr_col;               /* what column our player is at */
+    int board_row;              /* row the top of the level is drawn at */
+    int board_col;              /* column the left of the level is drawn at */
     int boxes_left;             /* boxes we still have to put on a goal */
 
     game_state_t game_state;    /* state of actively running game */
@@ -87,7 +89,8 @@ typedef struct {
  *  game or the game is paused/in level summary, then we do nothing. Otherwise,
  *  increment the number of ticks in the current level of the game. I decided
  *  to display time up to 0.1 second granularity, so whenever the level ticks is
- *  divisble by 10, we update the displayed time.
+ *  divisble by 10, we post the new time to be drawn by the main loop, rather
+ *  than drawing it from inside the interrupt.
  *
  *  @return Void.
  */
@@ -101,5 +104,14 @@ void sokoban_tickback(void);
  *  @return Void.
  */
 void sokoban_initialize_and_run(void);
+/** @brief draws the board with mode 13h tiles instead of text
+ *
+ *  The text screens stay text; the VGA switches to graphics for the board
+ *  and back again whenever a text screen is shown. Levels too big for the
+ *  tile grid are still shown as text.
+ *
+ *  @return Void.
+ */
+void sokoban_use_tiles(void);
 
 #endif /* __SOKOBAN_GAME_H_ */
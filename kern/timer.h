@@ -17,7 +17,8 @@
 #include <timer_defines.h>  /* TIMER_RATE */
 
 /* 100 ten ms intervals in 1 sec, so do TIMER_RATE / 100 to get cycles / 10ms */
-#define CYCLES_10_MS (TIMER_RATE / 100)
+#define TICKS_PER_SECOND 100
+#define CYCLES_10_MS (TIMER_RATE / TICKS_PER_SECOND)
 
 typedef struct {
     unsigned int numTicks;
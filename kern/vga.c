@@ -0,0 +1,411 @@
+/** @file vga.c
+ *  @brief VGA text mode implementation
+ *
+ *  Each mode is a table of the register values that differ between the text
+ *  modes we support; the graphics controller and attribute controller setup
+ *  the BIOS left behind for 80x25 is shared by all of them, apart from the
+ *  horizontal panning that depends on the character width. The register
+ *  values are the usual ones for these modes, e.g. 90x60 is 720x480 with an
+ *  8x8 font off the 28MHz dot clock.
+ *
+ *  The 50 and 60 row modes use 8 line glyphs. Rather than carrying a second
+ *  font around, the first time one of them is set the 8x16 font in character
+ *  map 0 of plane 2 is squashed into character map 1 by or-ing each pair of
+ *  lines together, which keeps every stroke of the glyph visible.
+ *
+ *  Mode 13h is chained, so its pixels land in all four planes, font included.
+ *  Switching to it first copies character map 0 out to RAM, and the next
+ *  switch back to text copies it back in and rebuilds the 8x8 font if it's
+ *  needed. Since text modes can now follow a graphics mode, they program the
+ *  sequencer, graphics controller and attribute controller in full too
+ *  rather than relying on what the BIOS left there.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug The 8x8 glyphs made from the 8x16 font are a bit bolder than a font
+ *       drawn for 8 lines would be.
+ */
+
+#include <stddef.h>         /* NULL */
+#include <stdbool.h>        /* bool */
+#include <stdint.h>         /* uint8_t */
+#include <string.h>         /* memcpy(), strcmp() */
+#include <asm.h>            /* inb(), outb() */
+#include <video_defines.h>  /* CRTC_CURSOR_LSB_IDX */
+#include <console.h>        /* console_crtc_write() */
+
+#include <vga.h>
+
+/* miscellaneous output register, written and read at different ports */
+#define VGA_MISC_WRITE      0x3C2
+/* sequencer index port, with data at the next port, and its registers */
+#define VGA_SEQ_IDX_REG     0x3C4
+#define SEQ_RESET_IDX       0x00
+#define SEQ_CLOCKING_IDX    0x01
+#define SEQ_MAP_MASK_IDX    0x02
+#define SEQ_CHAR_MAP_IDX    0x03
+#define SEQ_MEM_MODE_IDX    0x04
+/* graphics controller index port, data at the next port, and its registers */
+#define VGA_GC_IDX_REG      0x3CE
+#define GC_READ_MAP_IDX     0x04
+#define GC_MODE_IDX         0x05
+#define GC_MISC_IDX         0x06
+/* attribute controller, whose index/data share a port behind a flip-flop */
+#define VGA_AC_REG          0x3C0
+#define VGA_INPUT_STATUS    0x3DA
+#define AC_PALETTE_ENABLE   0x20
+#define AC_MODE_IDX         0x10
+#define AC_PANNING_IDX      0x13
+#define AC_REGS             0x15
+/* DAC index port for writes, with the red, green, blue values at 0x3C9 */
+#define VGA_DAC_WRITE_IDX   0x3C8
+#define VGA_DAC_DATA        0x3C9
+
+/* first of the CRTC registers up to the cursor the console manages itself */
+#define CRTC_START_ADDR_MSB_IDX 0x0C
+/* vertical retrace end register, bit 7 of which write protects 0x00-0x07 */
+#define CRTC_VRETRACE_END_IDX   0x11
+#define CRTC_PROTECT            0x80
+
+/* sequencer and graphics controller registers that differ between modes */
+#define SEQ_REGS            5
+#define GC_REGS             9
+
+/* values of the sequencer/graphics controller registers for text modes */
+#define SEQ_RESET_SYNC      0x01
+#define SEQ_RESET_RUN       0x03
+#define SEQ_MAP_MASK_TEXT   0x03
+#define SEQ_MEM_MODE_TEXT   0x02
+#define GC_READ_MAP_TEXT    0x00
+#define GC_MODE_TEXT        0x10
+#define GC_MISC_TEXT        0x0E
+/* and what they're set to in order to read and write plane 2 at 0xA0000 */
+#define SEQ_MAP_MASK_FONT   0x04
+#define SEQ_MEM_MODE_FONT   0x06
+#define GC_READ_MAP_FONT    0x02
+#define GC_MODE_FONT        0x00
+#define GC_MISC_FONT        0x04
+#define FONT_MEM_BASE       0xA0000
+
+/* character maps are 8KB apart in two interleaved sets, map 1 is at 16KB */
+#define FONT_MAP1_OFFSET    0x4000
+/* character map select values using map 0 or map 1 for both fonts */
+#define CHAR_MAP_0          0x00
+#define CHAR_MAP_1          0x05
+/* every glyph takes 32 bytes of plane 2, whatever its height */
+#define FONT_GLYPH_BYTES    32
+#define FONT_GLYPHS         256
+#define FONT_8X8_LINES      8
+#define FONT_8X16_LINES     16
+
+/* horizontal panning that lines up the first pixel with 9 or 8 dot chars */
+#define PANNING_9_DOT       0x08
+#define PANNING_8_DOT       0x00
+/* clocking mode bit selecting 8 dot chars */
+#define CLOCKING_8_DOT      0x01
+
+/* all of the text modes we can switch to */
+static const vga_text_mode_t modes[] = {
+    {
+        .name = "80x25", .width = 80, .height = 25,
+        .misc = 0x67, .clocking = 0x00, .font_8x8 = false,
+        .crtc = {
+            0x5F, 0x4F, 0x50, 0x82, 0x55, 0x81, 0xBF, 0x1F,
+            0x00, 0x4F, 0x0D, 0x0E, 0x00, 0x00, 0x00, 0x00,
+            0x9C, 0x8E, 0x8F, 0x28, 0x1F, 0x96, 0xB9, 0xA3,
+            0xFF,
+        },
+    },
+    {
+        .name = "80x50", .width = 80, .height = 50,
+        .misc = 0x67, .clocking = 0x00, .font_8x8 = true,
+        .crtc = {
+            0x5F, 0x4F, 0x50, 0x82, 0x55, 0x81, 0xBF, 0x1F,
+            0x00, 0x47, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00,
+            0x9C, 0x8E, 0x8F, 0x28, 0x1F, 0x96, 0xB9, 0xA3,
+            0xFF,
+        },
+    },
+    {
+        .name = "90x60", .width = 90, .height = 60,
+        .misc = 0xE7, .clocking = CLOCKING_8_DOT, .font_8x8 = true,
+        .crtc = {
+            0x6B, 0x59, 0x5A, 0x82, 0x60, 0x8D, 0x0B, 0x3E,
+            0x00, 0x47, 0x06, 0x07, 0x00, 0x00, 0x00, 0x00,
+            0xEA, 0x0C, 0xDF, 0x2D, 0x08, 0xE8, 0x05, 0xA3,
+            0xFF,
+        },
+    },
+};
+#define NUM_MODES ((int)(sizeof(modes) / sizeof(modes[0])))
+
+/* sequencer, graphics controller and attribute controller for text */
+static const uint8_t text_seq[SEQ_REGS] = {
+    SEQ_RESET_SYNC, 0x00, SEQ_MAP_MASK_TEXT, 0x00, SEQ_MEM_MODE_TEXT,
+};
+static const uint8_t text_gc[GC_REGS] = {
+    0x00, 0x00, 0x00, 0x00, GC_READ_MAP_TEXT, GC_MODE_TEXT, GC_MISC_TEXT,
+    0x00, 0xFF,
+};
+static const uint8_t text_ac[AC_REGS] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x14, 0x07,
+    0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x0C, 0x00, 0x0F, PANNING_9_DOT, 0x00,
+};
+
+/* every register of 320x200 with 256 colors, chained into one plane */
+#define MODE13H_MISC 0x63
+static const uint8_t mode13h_seq[SEQ_REGS] = {
+    SEQ_RESET_SYNC, 0x01, 0x0F, 0x00, 0x0E,
+};
+static const uint8_t mode13h_crtc[VGA_CRTC_REGS] = {
+    0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0xBF, 0x1F,
+    0x00, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x9C, 0x0E, 0x8F, 0x28, 0x40, 0x96, 0xB9, 0xA3,
+    0xFF,
+};
+static const uint8_t mode13h_gc[GC_REGS] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x05, 0x0F,
+    0xFF,
+};
+static const uint8_t mode13h_ac[AC_REGS] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x41, 0x00, 0x0F, 0x00, 0x00,
+};
+
+/* whether character map 1 holds the 8x8 font yet */
+static bool font_8x8_loaded = false;
+/* character map 0, copied out before mode 13h draws over it */
+static uint8_t saved_font[FONT_GLYPHS * FONT_GLYPH_BYTES];
+static bool font_saved = false;
+/* whether plane 2 has to get saved_font back before text is shown again */
+static bool font_clobbered = false;
+
+/** @brief writes one register behind an index/data port pair
+ *
+ *  @param idx_port port the register index is written to, data goes to the
+ *         port right after it
+ *  @param index register to write
+ *  @param value value to write to it
+ *  @return Void.
+ */
+static inline void write_reg(uint16_t idx_port, uint8_t index, uint8_t value)
+{
+    outb(idx_port, index);
+    outb(idx_port + 1, value);
+}
+
+/** @brief writes a run of registers behind an index/data port pair
+ *
+ *  @param idx_port port the register index is written to
+ *  @param values values of registers 0 through count - 1
+ *  @param count number of registers to write
+ *  @return Void.
+ */
+static void write_regs(uint16_t idx_port, const uint8_t *values, int count)
+{
+    int index;
+    for (index = 0; index < count; index++) {
+        write_reg(idx_port, index, values[index]);
+    }
+}
+
+/** @brief writes every attribute controller register
+ *
+ *  The palette registers only take writes with the display off, so it's
+ *  turned back on at the end.
+ *
+ *  @param values values of registers 0 through AC_REGS - 1
+ *  @return Void.
+ */
+static void write_ac(const uint8_t *values)
+{
+    /* reading the status register points the flip-flop back at the index */
+    inb(VGA_INPUT_STATUS);
+    int index;
+    for (index = 0; index < AC_REGS; index++) {
+        outb(VGA_AC_REG, index);
+        outb(VGA_AC_REG, values[index]);
+    }
+    outb(VGA_AC_REG, AC_PALETTE_ENABLE);
+}
+
+/** @brief maps plane 2 in at FONT_MEM_BASE with odd/even addressing off
+ *
+ *  @return Void.
+ */
+static void map_font_plane(void)
+{
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MAP_MASK_IDX, SEQ_MAP_MASK_FONT);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MEM_MODE_IDX, SEQ_MEM_MODE_FONT);
+    write_reg(VGA_GC_IDX_REG, GC_READ_MAP_IDX, GC_READ_MAP_FONT);
+    write_reg(VGA_GC_IDX_REG, GC_MODE_IDX, GC_MODE_FONT);
+    write_reg(VGA_GC_IDX_REG, GC_MISC_IDX, GC_MISC_FONT);
+}
+
+/** @brief puts memory access back the way text mode needs it
+ *
+ *  @return Void.
+ */
+static void unmap_font_plane(void)
+{
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MAP_MASK_IDX, SEQ_MAP_MASK_TEXT);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MEM_MODE_IDX, SEQ_MEM_MODE_TEXT);
+    write_reg(VGA_GC_IDX_REG, GC_READ_MAP_IDX, GC_READ_MAP_TEXT);
+    write_reg(VGA_GC_IDX_REG, GC_MODE_IDX, GC_MODE_TEXT);
+    write_reg(VGA_GC_IDX_REG, GC_MISC_IDX, GC_MISC_TEXT);
+}
+
+/** @brief copies character map 0 between plane 2 and saved_font
+ *
+ *  @param save whether to copy out of plane 2 rather than into it
+ *  @return Void.
+ */
+static void copy_font(bool save)
+{
+    map_font_plane();
+    volatile uint8_t *font = (volatile uint8_t*)FONT_MEM_BASE;
+    int i;
+    for (i = 0; i < (int)sizeof(saved_font); i++) {
+        if (save) {
+            saved_font[i] = font[i];
+        }
+        else {
+            font[i] = saved_font[i];
+        }
+    }
+    unmap_font_plane();
+}
+
+/** @brief makes the 8x8 font in character map 1 out of the 8x16 in map 0
+ *
+ *  Copies the glyphs over with plane 2 mapped in, then puts everything back
+ *  the way text mode needs it.
+ *
+ *  @return Void.
+ */
+static void load_8x8_font(void)
+{
+    map_font_plane();
+
+    volatile uint8_t *src = (volatile uint8_t*)FONT_MEM_BASE;
+    volatile uint8_t *dst = src + FONT_MAP1_OFFSET;
+    int glyph;
+    for (glyph = 0; glyph < FONT_GLYPHS; glyph++) {
+        int line;
+        for (line = 0; line < FONT_8X8_LINES; line++) {
+            dst[line] = src[2 * line] | src[2 * line + 1];
+        }
+        src += FONT_GLYPH_BYTES;
+        dst += FONT_GLYPH_BYTES;
+    }
+
+    unmap_font_plane();
+    font_8x8_loaded = true;
+}
+
+const vga_text_mode_t *vga_find_text_mode(const char *name)
+{
+    int i;
+    for (i = 0; i < NUM_MODES; i++) {
+        if (strcmp(modes[i].name, name) == 0) {
+            return &modes[i];
+        }
+    }
+    return NULL;
+}
+
+void vga_set_text_mode(const vga_text_mode_t *mode)
+{
+    if (font_clobbered) {
+        copy_font(false);
+        font_clobbered = false;
+    }
+    if (mode->font_8x8 && !font_8x8_loaded) {
+        load_8x8_font();
+    }
+
+    /* the dot clock may change, so hold the sequencer in reset meanwhile */
+    write_reg(VGA_SEQ_IDX_REG, SEQ_RESET_IDX, SEQ_RESET_SYNC);
+    outb(VGA_MISC_WRITE, mode->misc);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_CLOCKING_IDX, mode->clocking);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MAP_MASK_IDX, text_seq[SEQ_MAP_MASK_IDX]);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_CHAR_MAP_IDX,
+              mode->font_8x8 ? CHAR_MAP_1 : CHAR_MAP_0);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_MEM_MODE_IDX, text_seq[SEQ_MEM_MODE_IDX]);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_RESET_IDX, SEQ_RESET_RUN);
+    write_regs(VGA_GC_IDX_REG, text_gc, GC_REGS);
+
+    /* unprotect the horizontal timing registers until we're done */
+    console_crtc_write(CRTC_VRETRACE_END_IDX,
+                       mode->crtc[CRTC_VRETRACE_END_IDX] & ~CRTC_PROTECT);
+    int index;
+    for (index = 0; index < VGA_CRTC_REGS; index++) {
+        if (index >= CRTC_START_ADDR_MSB_IDX &&
+            index <= CRTC_CURSOR_LSB_IDX) {
+            continue;
+        }
+        if (index == CRTC_VRETRACE_END_IDX) {
+            continue;
+        }
+        console_crtc_write(index, mode->crtc[index]);
+    }
+    console_crtc_write(CRTC_VRETRACE_END_IDX,
+                       mode->crtc[CRTC_VRETRACE_END_IDX]);
+
+    uint8_t ac[AC_REGS];
+    memcpy(ac, text_ac, sizeof(ac));
+    if (mode->clocking & CLOCKING_8_DOT) {
+        ac[AC_PANNING_IDX] = PANNING_8_DOT;
+    }
+    write_ac(ac);
+}
+
+void vga_set_mode13h(void)
+{
+    if (!font_clobbered) {
+        copy_font(true);
+        font_saved = true;
+        font_clobbered = true;
+        /* map 1 is in plane 2 too, so it gets made again when it's needed */
+        font_8x8_loaded = false;
+    }
+
+    write_reg(VGA_SEQ_IDX_REG, SEQ_RESET_IDX, SEQ_RESET_SYNC);
+    outb(VGA_MISC_WRITE, MODE13H_MISC);
+    write_regs(VGA_SEQ_IDX_REG, mode13h_seq, SEQ_REGS);
+    write_reg(VGA_SEQ_IDX_REG, SEQ_RESET_IDX, SEQ_RESET_RUN);
+
+    console_crtc_write(CRTC_VRETRACE_END_IDX,
+                       mode13h_crtc[CRTC_VRETRACE_END_IDX] & ~CRTC_PROTECT);
+    int index;
+    for (index = 0; index < VGA_CRTC_REGS; index++) {
+        if (index != CRTC_VRETRACE_END_IDX) {
+            console_crtc_write(index, mode13h_crtc[index]);
+        }
+    }
+    console_crtc_write(CRTC_VRETRACE_END_IDX,
+                       mode13h_crtc[CRTC_VRETRACE_END_IDX]);
+
+    write_regs(VGA_GC_IDX_REG, mode13h_gc, GC_REGS);
+    write_ac(mode13h_ac);
+}
+
+void vga_set_palette(int first, const uint8_t (*rgb)[3], int count)
+{
+    outb(VGA_DAC_WRITE_IDX, first);
+    int i;
+    for (i = 0; i < count; i++) {
+        outb(VGA_DAC_DATA, rgb[i][0]);
+        outb(VGA_DAC_DATA, rgb[i][1]);
+        outb(VGA_DAC_DATA, rgb[i][2]);
+    }
+}
+
+const uint8_t *vga_font_glyph(unsigned char ch)
+{
+    if (!font_saved) {
+        return NULL;
+    }
+    return &saved_font[ch * FONT_GLYPH_BYTES];
+}
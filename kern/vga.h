@@ -0,0 +1,89 @@
+/** @file vga.h
+ *  @brief VGA text mode interface
+ *
+ *  Interface for switching the VGA between text modes with more or fewer
+ *  rows and columns than the 80x25 the BIOS leaves it in, and into the
+ *  320x200 256 color graphics mode 13h. Only the registers are touched here;
+ *  keeping the console's idea of the screen in step with them is up to
+ *  console_set_mode() and console_reclaim_vga().
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef __VGA_H_
+#define __VGA_H_
+
+#include <stdint.h>     /* uint8_t */
+#include <stdbool.h>    /* bool */
+
+/* number of CRTC registers a mode programs, indices 0x00 through 0x18 */
+#define VGA_CRTC_REGS 25
+
+/* mode 13h is one byte per pixel, a row after the other, at 0xA0000 */
+#define VGA_MODE13H_MEM     0xA0000
+#define VGA_MODE13H_WIDTH   320
+#define VGA_MODE13H_HEIGHT  200
+/* lines of the glyphs vga_font_glyph() hands out, one byte per line */
+#define VGA_GLYPH_LINES     16
+
+/* everything needed to put the VGA into one text mode */
+typedef struct {
+    const char *name;           /* "<width>x<height>" */
+    int width;                  /* columns of text */
+    int height;                 /* rows of text */
+    uint8_t misc;               /* miscellaneous output register */
+    uint8_t clocking;           /* sequencer clocking mode, 8 or 9 dot chars */
+    bool font_8x8;              /* whether glyphs are 8 instead of 16 lines */
+    uint8_t crtc[VGA_CRTC_REGS];
+} vga_text_mode_t;
+
+/** @brief looks up a text mode by name
+ *
+ *  @param name name of the mode, such as "80x50"
+ *  @return the mode, or NULL if there is no mode with that name
+ */
+const vga_text_mode_t *vga_find_text_mode(const char *name);
+/** @brief programs the VGA registers for a text mode
+ *
+ *  Modes with 8 line glyphs need an 8x8 font, which is made from the 8x16
+ *  font the BIOS loaded the first time one is set, and kept in a second
+ *  character map so the original stays intact for 80x25. Neither the start
+ *  address nor the cursor location is touched.
+ *
+ *  @pre interrupts are disabled, since VGA memory isn't mapped at
+ *       CONSOLE_MEM_BASE while the font is being made
+ *  @param mode mode to switch to
+ *  @return Void.
+ */
+void vga_set_text_mode(const vga_text_mode_t *mode);
+/** @brief programs the VGA registers for 320x200 with 256 colors
+ *
+ *  The font is copied out to RAM first, since the pixels are written over it,
+ *  and the next vga_set_text_mode() puts it back. Whatever was in VGA memory
+ *  is shown as garbage until it's drawn over.
+ *
+ *  @pre interrupts are disabled, as for vga_set_text_mode()
+ *  @return Void.
+ */
+void vga_set_mode13h(void);
+/** @brief sets colors of the DAC, which mode 13h pixels index directly
+ *
+ *  Text modes only use entries 0-7, 20 and 56-63, so anything else can be
+ *  set without upsetting them.
+ *
+ *  @param first index of the first color to set
+ *  @param rgb red, green and blue of each color, 6 bits each
+ *  @param count number of colors to set
+ *  @return Void.
+ */
+void vga_set_palette(int first, const uint8_t (*rgb)[3], int count);
+/** @brief finds the bitmap of a character in the text mode font
+ *
+ *  @param ch character to look up
+ *  @return VGA_GLYPH_LINES bytes, one per line with the leftmost pixel in
+ *          the top bit, or NULL if vga_set_mode13h() hasn't saved the font
+ *          yet
+ */
+const uint8_t *vga_font_glyph(unsigned char ch);
+
+#endif /* __VGA_H_ */
@@ -0,0 +1,29 @@
+/** @file decoders.h
+ *  @brief the two scancode decoders keyhelp_check compares
+ *
+ *  table_decoder.c and switch_decoder.c each pull in one version of
+ *  keyhelp.c and rename its process_scancode(), so both can be linked into
+ *  the same host program. Including the source also gives each wrapper its
+ *  decoder's static state, which the reset functions put back to power on.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#ifndef _DECODERS_H
+#define _DECODERS_H
+
+#include <x86/keyhelp.h>
+
+/** @brief decodes a byte with the table driven keyhelp.c */
+kh_type table_process_scancode(int keypress);
+
+/** @brief decodes a byte with the old switch based keyhelp_switch.c */
+kh_type switch_process_scancode(int keypress);
+
+/** @brief puts the table decoder back in its initial state */
+void table_reset(void);
+
+/** @brief puts the switch decoder back in its initial state */
+void switch_reset(void);
+
+#endif /* _DECODERS_H */
@@ -0,0 +1,201 @@
+/** @file keyhelp_check.c
+ *  @brief checks the table driven scancode decoder against the old switch
+ *
+ *  Both decoders are fed the same bytes and every result has to match bit
+ *  for bit. The exhaustive pass starts each check from a fresh decoder,
+ *  presses one of the 256 combinations of the eight modifier keys, walks
+ *  into one of the partial E0, Print Screen or Pause sequences, and then
+ *  decodes every one of the 256 bytes, followed by a short tail of bytes
+ *  that shows up any difference the byte left in the sequence state. A long
+ *  pseudo random stream covers whatever that misses.
+ *
+ *  The benchmark then decodes the same random stream with each decoder and
+ *  prints the time per byte. Build and run with "make run" from this
+ *  directory; it uses the host's cc and needs nothing from the 410 tools.
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "decoders.h"
+
+/** @brief bytes in the random stream */
+#define STREAM_LEN (1 << 22)
+/** @brief times the stream is decoded by each decoder in the benchmark */
+#define BENCH_PASSES 16
+/** @brief longest byte sequence in the tables below */
+#define SEQ_MAX 6
+
+/** @brief a short run of scancode bytes */
+typedef struct {
+    int len;
+    unsigned char bytes[SEQ_MAX];
+} seq_t;
+
+/** @brief make codes of the modifiers, one per bit of a modifier set */
+static const seq_t modifiers[] = {
+    { 1, { 0x2A } },                /* left shift */
+    { 1, { 0x36 } },                /* right shift */
+    { 1, { 0x1D } },                /* left control */
+    { 2, { 0xE0, 0x1D } },          /* right control */
+    { 1, { 0x38 } },                /* left alt */
+    { 2, { 0xE0, 0x38 } },          /* right alt */
+    { 1, { 0x3A } },                /* caps lock */
+    { 1, { 0x45 } },                /* num lock */
+};
+#define N_MODIFIERS (int)(sizeof(modifiers) / sizeof(modifiers[0]))
+
+/** @brief every partial sequence the decoder can be left in */
+static const seq_t prefixes[] = {
+    { 0, { 0 } },
+    { 1, { 0xE0 } },
+    { 2, { 0xE0, 0x2A } },
+    { 3, { 0xE0, 0x2A, 0xE0 } },
+    { 2, { 0xE0, 0xB7 } },
+    { 3, { 0xE0, 0xB7, 0xE0 } },
+    { 1, { 0xE1 } },
+    { 2, { 0xE1, 0x1D } },
+    { 3, { 0xE1, 0x1D, 0x45 } },
+    { 4, { 0xE1, 0x1D, 0x45, 0xE1 } },
+    { 5, { 0xE1, 0x1D, 0x45, 0xE1, 0x9D } },
+};
+#define N_PREFIXES (int)(sizeof(prefixes) / sizeof(prefixes[0]))
+
+/** @brief bytes decoded after the one under test, to compare the state it
+ *  left behind */
+static const seq_t tail = { 6, { 0x1E, 0xE0, 0x37, 0x9D, 0xC5, 0x9E } };
+
+static unsigned long checks;
+static unsigned long mismatches;
+
+/** @brief decodes one byte with both decoders and compares the results */
+static void check_byte(int byte)
+{
+    kh_type want = switch_process_scancode(byte);
+    kh_type got = table_process_scancode(byte);
+
+    checks++;
+    if (want != got) {
+        if (mismatches++ < 10) {
+            printf("mismatch on 0x%02X: switch 0x%08X, table 0x%08X\n",
+                   byte, (unsigned)want, (unsigned)got);
+        }
+    }
+}
+
+/** @brief decodes a sequence with both decoders, comparing every byte */
+static void check_seq(const seq_t *seq)
+{
+    int i;
+    for (i = 0; i < seq->len; i++) {
+        check_byte(seq->bytes[i]);
+    }
+}
+
+/** @brief every modifier set, partial sequence and byte */
+static void check_exhaustive(void)
+{
+    int mods, prefix, byte, i;
+
+    for (mods = 0; mods < (1 << N_MODIFIERS); mods++) {
+        for (prefix = 0; prefix < N_PREFIXES; prefix++) {
+            for (byte = 0; byte < 0x100; byte++) {
+                switch_reset();
+                table_reset();
+                for (i = 0; i < N_MODIFIERS; i++) {
+                    if (mods & (1 << i)) {
+                        check_seq(&modifiers[i]);
+                    }
+                }
+                check_seq(&prefixes[prefix]);
+                check_byte(byte);
+                check_seq(&tail);
+            }
+        }
+    }
+}
+
+/** @brief a small xorshift generator, so runs are repeatable */
+static uint32_t next_random(uint32_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+/** @brief compares the decoders over the random stream */
+static void check_stream(const unsigned char *stream)
+{
+    int i;
+
+    switch_reset();
+    table_reset();
+    for (i = 0; i < STREAM_LEN; i++) {
+        check_byte(stream[i]);
+    }
+}
+
+/** @brief nanoseconds on the host's monotonic clock */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** @brief times a decoder over the random stream
+ *
+ *  @return nanoseconds per byte
+ */
+static double bench(kh_type (*decode)(int), void (*reset)(void),
+                    const unsigned char *stream)
+{
+    volatile kh_type sink;
+    kh_type acc = 0;
+    double start;
+    int pass, i;
+
+    reset();
+    start = now_ns();
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        for (i = 0; i < STREAM_LEN; i++) {
+            acc ^= decode(stream[i]);
+        }
+    }
+    sink = acc;
+    (void)sink;
+    return (now_ns() - start) / ((double)BENCH_PASSES * STREAM_LEN);
+}
+
+int main(void)
+{
+    unsigned char *stream = malloc(STREAM_LEN);
+    uint32_t seed = 0x410;
+    double switch_ns, table_ns;
+    int i;
+
+    if (stream == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    for (i = 0; i < STREAM_LEN; i++) {
+        stream[i] = next_random(&seed) & 0xFF;
+    }
+
+    check_exhaustive();
+    check_stream(stream);
+    printf("%lu checks, %lu mismatches\n", checks, mismatches);
+
+    switch_ns = bench(switch_process_scancode, switch_reset, stream);
+    table_ns = bench(table_process_scancode, table_reset, stream);
+    printf("switch: %.2f ns/byte\n", switch_ns);
+    printf("table:  %.2f ns/byte (%.2fx)\n", table_ns, switch_ns / table_ns);
+
+    free(stream);
+    return mismatches != 0;
+}
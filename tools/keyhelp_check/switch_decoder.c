@@ -0,0 +1,18 @@
+/** @file switch_decoder.c
+ *  @brief the old switch based decoder, built for the host
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#include "decoders.h"
+
+#define process_scancode switch_process_scancode
+#include "keyhelp_switch.c"
+#undef process_scancode
+
+void switch_reset(void)
+{
+    key_state = 0;
+    key_internal_state = 0;
+    key_sequence = 0;
+}
@@ -0,0 +1,19 @@
+/** @file table_decoder.c
+ *  @brief the kernel's table driven decoder, built for the host
+ *
+ *  @author Bradley Zhou (bradleyz)
+ *  @bug No known bugs.
+ */
+#include "decoders.h"
+
+#define process_scancode table_process_scancode
+#include "../../410kern/x86/keyhelp.c"
+#undef process_scancode
+
+void table_reset(void)
+{
+    key_state = 0;
+    key_extended = 0;
+    pause_stage = 0;
+    prscr_state = PRSCR_NONE;
+}